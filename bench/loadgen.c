@@ -0,0 +1,362 @@
+/*
+ * LOAD GENERATOR FOR MYHTTPD
+ * Build with : make loadgen, or let make bench build it
+ *
+ * Closed loop (default) : every connection sends its next request as soon as the previous response is in.
+ * Open loop (-R rate) : requests are sent on a fixed schedule and latency is counted from the time a
+ * request was due, so a stalled server is not hidden by the generator slowing down with it.
+ *
+ * The result is a single JSON line on stdout.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#define MAX_MIX_ENTRIES 32
+#define RESPONSE_BUFFER_SIZE (64 * 1024)
+
+/*
+ * FILE SIZE MIX : THE PATHS TO REQUEST AND HOW OFTEN EACH IS PICKED
+ */
+typedef struct mix_entry {
+	char path[200];
+	int weight;
+} MixEntry;
+
+/*
+ * EVERY CONNECTION IS DRIVEN BY ITS OWN THREAD AND KEEPS ITS OWN RESULTS
+ */
+typedef struct client {
+	int id;
+	pthread_t thread;
+	unsigned int seed;
+	long long *latencies_us;
+	long count, capacity;
+	long errors;
+	long long bytes;
+} Client;
+
+MixEntry mix[MAX_MIX_ENTRIES];
+int mix_count = 0, mix_total_weight = 0;
+char host[64] = "127.0.0.1", label[100] = "";
+int port_number = 8080, concurrency = 16, duration = 10, keep_alive = 1;
+double rate = 0;	/* requests per second over all connections, 0 = closed loop */
+long long start_ns, stop_ns;
+
+void usage();
+void parse_mix(char *spec);
+void client_routine(void *client_argument);
+int connect_to_server();
+int send_request(int sockfd, char path[]);
+long read_response(int sockfd, char buffer[], int *server_closes);
+void record_latency(Client *client, long long latency_us);
+long long get_monotonic_ns();
+void sleep_until(long long deadline_ns);
+int compare_latencies(const void *first, const void *second);
+long long percentile(long long *latencies, long count, double fraction);
+
+int main(int argc, char *argv[]){
+	Client *clients;
+	long long *latencies;
+	long total = 0, errors = 0, i, offset = 0;
+	long long bytes = 0;
+	double elapsed;
+	int ch;
+
+	while ((ch = getopt(argc, argv, "H:p:c:d:R:k:m:L:h")) != -1){
+		switch(ch){
+			case 'H':
+				strncpy(host, optarg, sizeof(host) - 1);
+				break;
+			case 'p':
+				port_number = atoi(optarg);
+				break;
+			case 'c':
+				concurrency = atoi(optarg);
+				break;
+			case 'd':
+				duration = atoi(optarg);
+				break;
+			case 'R':
+				rate = atof(optarg);
+				break;
+			case 'k':
+				keep_alive = atoi(optarg);
+				break;
+			case 'm':
+				parse_mix(optarg);
+				break;
+			case 'L':
+				strncpy(label, optarg, sizeof(label) - 1);
+				break;
+			default:
+				usage();
+				exit(1);
+		}
+	}
+	if (mix_count == 0)
+		parse_mix("/index.html:1");
+	if (concurrency < 1)
+		concurrency = 1;
+
+	clients = (Client *)calloc(concurrency, sizeof(Client));
+	start_ns = get_monotonic_ns();
+	stop_ns = start_ns + (long long)duration * 1000000000;
+	for (i = 0; i < concurrency; i++){
+		clients[i].id = i;
+		clients[i].seed = 12345 + i;
+		if (pthread_create(&clients[i].thread, NULL, (void *) &client_routine, (void *) &clients[i]) != 0){
+			perror("Error creating a client thread");
+			exit(1);
+		}
+	}
+	for (i = 0; i < concurrency; i++){
+		pthread_join(clients[i].thread, NULL);
+		total += clients[i].count;
+		errors += clients[i].errors;
+		bytes += clients[i].bytes;
+	}
+	elapsed = (get_monotonic_ns() - start_ns) / 1e9;
+
+	/* merge the latencies of every connection */
+	latencies = (long long *)malloc((total + 1) * sizeof(long long));
+	for (i = 0; i < concurrency; i++){
+		memcpy(latencies + offset, clients[i].latencies_us, clients[i].count * sizeof(long long));
+		offset += clients[i].count;
+		free(clients[i].latencies_us);
+	}
+	qsort(latencies, total, sizeof(long long), compare_latencies);
+
+	printf("{\"label\":\"%s\",\"mode\":\"%s\",\"concurrency\":%d,\"keep_alive\":%d,\"duration_s\":%.3f,\"requests\":%ld,\"errors\":%ld,\"bytes\":%lld,\"rps\":%.1f,\"p50_us\":%lld,\"p99_us\":%lld,\"p999_us\":%lld,\"max_us\":%lld}\n",
+		label, (rate > 0) ? "open" : "closed", concurrency, keep_alive, elapsed, total, errors, bytes, total / elapsed,
+		percentile(latencies, total, 0.5), percentile(latencies, total, 0.99), percentile(latencies, total, 0.999), percentile(latencies, total, 1.0));
+	free(latencies);
+	free(clients);
+	return 0;
+}
+
+void usage(){
+	fprintf(stderr, "Usage Summary: loadgen -H host -p port -c connections -d seconds -R rate -k keepalive -m mix -L label\n");
+	fprintf(stderr, "Give -c and then the number of concurrent connections for example: -c 64\n");
+	fprintf(stderr, "Give -R and then requests per second to run open loop instead of closed loop for example: -R 5000\n");
+	fprintf(stderr, "Give -k 0 to open a new connection for every request\n");
+	fprintf(stderr, "Give -m and then path:weight pairs for the file size mix for example: -m /small.html:8,/large.html:1\n");
+	fprintf(stderr, "Give -L and then a label copied into the JSON result\n");
+}
+
+/*
+ * PARSE path:weight,path:weight
+ */
+void parse_mix(char *spec){
+	char *copy = strdup(spec), *entry, *saveptr = NULL, *colon;
+
+	for (entry = strtok_r(copy, ",", &saveptr); entry != NULL && mix_count < MAX_MIX_ENTRIES; entry = strtok_r(NULL, ",", &saveptr)){
+		colon = strrchr(entry, ':');
+		mix[mix_count].weight = 1;
+		if (colon != NULL){
+			*colon = '\0';
+			mix[mix_count].weight = atoi(colon + 1);
+		}
+		if (mix[mix_count].weight <= 0)
+			continue;
+		strncpy(mix[mix_count].path, entry, sizeof(mix[mix_count].path) - 1);
+		mix_total_weight += mix[mix_count].weight;
+		mix_count++;
+	}
+	free(copy);
+}
+
+/*
+ * CLIENT ROUTINE : ONE CONNECTION, CLOSED OR OPEN LOOP UNTIL THE DURATION IS OVER
+ */
+void client_routine(void *client_argument){
+	Client *client = (Client *)client_argument;
+	char *buffer = (char *)malloc(RESPONSE_BUFFER_SIZE);
+	int sockfd = -1, pick, i, server_closes;
+	long long due_ns = 0, sent_ns, interval_ns = 0;
+	long body;
+
+	if (rate > 0){
+		/* the connections share the rate and start staggered across one interval */
+		interval_ns = (long long)(1e9 * concurrency / rate);
+		due_ns = start_ns + interval_ns * client -> id / concurrency;
+	}
+
+	while(1){
+		if (rate > 0){
+			if (due_ns >= stop_ns)
+				break;
+			sleep_until(due_ns);
+			sent_ns = due_ns;
+			due_ns += interval_ns;
+		}
+		else{
+			sent_ns = get_monotonic_ns();
+			if (sent_ns >= stop_ns)
+				break;
+		}
+
+		pick = rand_r(&client -> seed) % mix_total_weight;
+		for (i = 0; pick >= mix[i].weight; i++)
+			pick -= mix[i].weight;
+
+		if (sockfd < 0 && (sockfd = connect_to_server()) < 0){
+			client -> errors++;
+			continue;
+		}
+		body = -1;
+		if (send_request(sockfd, mix[i].path) == 0)
+			body = read_response(sockfd, buffer, &server_closes);
+		if (body < 0){
+			client -> errors++;
+			close(sockfd);
+			sockfd = -1;
+			continue;
+		}
+		client -> bytes += body;
+		record_latency(client, (get_monotonic_ns() - sent_ns) / 1000);
+		if (!keep_alive || server_closes){
+			close(sockfd);
+			sockfd = -1;
+		}
+	}
+	if (sockfd >= 0)
+		close(sockfd);
+	free(buffer);
+}
+
+int connect_to_server(){
+	struct sockaddr_in server;
+	int sockfd, one = 1;
+
+	memset(&server, 0, sizeof(server));
+	server.sin_family = AF_INET;
+	server.sin_port = htons(port_number);
+	inet_pton(AF_INET, host, &server.sin_addr);
+
+	sockfd = socket(AF_INET, SOCK_STREAM, 0);
+	if (sockfd < 0)
+		return -1;
+	setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	if (connect(sockfd, (struct sockaddr *) &server, sizeof(server)) < 0){
+		close(sockfd);
+		return -1;
+	}
+	return sockfd;
+}
+
+int send_request(int sockfd, char path[]){
+	char request[400];
+	int length, sent, offset = 0;
+
+	length = snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: %s\r\nConnection: %s\r\n\r\n", path, host, keep_alive ? "keep-alive" : "close");
+	while (offset < length){
+		sent = send(sockfd, request + offset, length - offset, MSG_NOSIGNAL);
+		if (sent < 0 && errno == EINTR)
+			continue;
+		if (sent <= 0)
+			return -1;
+		offset += sent;
+	}
+	return 0;
+}
+
+/*
+ * READ ONE RESPONSE : THE HEAD, THEN Content-Length BYTES OF BODY. RETURNS THE BODY LENGTH OR -1
+ */
+long read_response(int sockfd, char buffer[], int *server_closes){
+	int length = 0, received, head_length = 0;
+	long content_length = -1, body_received;
+	char *end, *line;
+
+	*server_closes = 0;
+	while (head_length == 0){
+		if (length == RESPONSE_BUFFER_SIZE - 1)
+			return -1;
+		received = recv(sockfd, buffer + length, RESPONSE_BUFFER_SIZE - 1 - length, 0);
+		if (received < 0 && errno == EINTR)
+			continue;
+		if (received <= 0)
+			return -1;
+		length += received;
+		buffer[length] = '\0';
+		/* myhttpd ends its head lines with a bare newline, other servers with CRLF */
+		if ((end = strstr(buffer, "\r\n\r\n")) != NULL)
+			head_length = end - buffer + 4;
+		else if ((end = strstr(buffer, "\n\n")) != NULL)
+			head_length = end - buffer + 2;
+	}
+
+	for (line = buffer; line != NULL && line < buffer + head_length; line = strchr(line, '\n')){
+		if (*line == '\n')
+			line++;
+		if (strncasecmp(line, "Content-Length:", 15) == 0)
+			content_length = atol(line + 15);
+		else if (strncasecmp(line, "Connection: close", 17) == 0)
+			*server_closes = 1;
+	}
+	if (content_length < 0)
+		return -1;
+
+	body_received = length - head_length;
+	while (body_received < content_length){
+		received = recv(sockfd, buffer, RESPONSE_BUFFER_SIZE, 0);
+		if (received < 0 && errno == EINTR)
+			continue;
+		if (received <= 0)
+			return -1;
+		body_received += received;
+	}
+	return content_length;
+}
+
+void record_latency(Client *client, long long latency_us){
+	if (client -> count == client -> capacity){
+		client -> capacity = (client -> capacity == 0) ? 4096 : 2 * client -> capacity;
+		client -> latencies_us = (long long *)realloc(client -> latencies_us, client -> capacity * sizeof(long long));
+	}
+	client -> latencies_us[client -> count++] = latency_us;
+}
+
+long long get_monotonic_ns(){
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (long long)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+void sleep_until(long long deadline_ns){
+	struct timespec deadline;
+
+	deadline.tv_sec = deadline_ns / 1000000000;
+	deadline.tv_nsec = deadline_ns % 1000000000;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR)
+		;
+}
+
+int compare_latencies(const void *first, const void *second){
+	long long first_latency = *(long long *)first, second_latency = *(long long *)second;
+
+	return (first_latency > second_latency) - (first_latency < second_latency);
+}
+
+long long percentile(long long *latencies, long count, double fraction){
+	long index;
+
+	if (count == 0)
+		return 0;
+	index = (long)(fraction * count);
+	if (index >= count)
+		index = count - 1;
+	return latencies[index];
+}
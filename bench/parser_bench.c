@@ -0,0 +1,180 @@
+/*
+ * PARSER MICROBENCHMARK : THE RESUMABLE parse_http_request AGAINST THE OLD BYTE BY BYTE FUNCTIONS
+ * Build with : make parser_bench (add -mavx2 to its command line for the AVX2 delimiter search)
+ * Whole : the head is parsed once it has fully arrived.
+ * Fragmented : the head arrives in FRAGMENT_SIZE pieces and the parser runs after every piece, as the listener does.
+ */
+#define MYHTTPD_NO_MAIN
+#include "../myhttpd_ketan.c"
+
+#define ROUNDS 1000000
+#define FRAGMENT_SIZE 64
+
+/* a head as sent by a current desktop browser */
+char browser_request[] =
+	"GET /index.html HTTP/1.1\r\n"
+	"Host: localhost:8080\r\n"
+	"Connection: keep-alive\r\n"
+	"Cache-Control: max-age=0\r\n"
+	"sec-ch-ua: \"Chromium\";v=\"124\", \"Google Chrome\";v=\"124\", \"Not-A.Brand\";v=\"99\"\r\n"
+	"sec-ch-ua-mobile: ?0\r\n"
+	"sec-ch-ua-platform: \"Linux\"\r\n"
+	"Upgrade-Insecure-Requests: 1\r\n"
+	"User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/124.0.0.0 Safari/537.36\r\n"
+	"Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,image/apng,*/*;q=0.8,application/signed-exchange;v=b3;q=0.7\r\n"
+	"Sec-Fetch-Site: none\r\n"
+	"Sec-Fetch-Mode: navigate\r\n"
+	"Sec-Fetch-User: ?1\r\n"
+	"Sec-Fetch-Dest: document\r\n"
+	"Accept-Encoding: gzip, deflate, br, zstd\r\n"
+	"Accept-Language: en-US,en;q=0.9\r\n"
+	"Cookie: session=4f2a9c1e7b3d8a6f0e5c2b9d4a7f1e3c; theme=dark; _ga=GA1.1.123456789.1700000000\r\n"
+	"If-Modified-Since: Sat, 17 Oct 2026 07:08:51 GMT\r\n"
+	"\r\n";
+
+/* the functions the listener used before the parser */
+int find_request_head_end_old(char buffer[]){
+	char *crlf, *lf;
+
+	crlf = strstr(buffer, "\r\n\r\n");
+	lf = strstr(buffer, "\n\n");
+	if (crlf != NULL && (lf == NULL || crlf < lf))
+		return crlf - buffer + 4;
+	if (lf != NULL)
+		return lf - buffer + 2;
+	return 0;
+}
+
+void get_request_type_old(char request[], char request_type[]){
+	int i = 0;
+
+	while(request[i] != ' '){
+		request_type[i] = request[i];
+		i++;
+	}
+	request_type[i] = '\0';
+}
+
+void get_file_name_old(char request[], char file_name[]){
+	int i = 0, j = 0;
+
+	while(request[i] != ' '){ i++; }
+	i++;
+	while(request[i] != ' '){
+		file_name[j] = request[i];
+		i++; j++;
+	}
+	file_name[j] = '\0';
+
+	i = 0; j = 1;
+	while(i < (int)strlen(file_name)){
+		file_name[i] = file_name[j];
+		i++; j++;
+	}
+}
+
+void get_header_value_old(char request[], char header_name[], char value[], int value_size){
+	char *line = request;
+	int name_length = strlen(header_name), i;
+
+	value[0] = '\0';
+	while ((line = strchr(line, '\n')) != NULL){
+		line++;
+		if (*line == '\r' || *line == '\n' || *line == '\0')
+			return;
+		if (strncasecmp(line, header_name, name_length) == 0 && line[name_length] == ':'){
+			line += name_length + 1;
+			while (*line == ' ' || *line == '\t')
+				line++;
+			for (i = 0; i < value_size - 1 && line[i] != '\r' && line[i] != '\n' && line[i] != '\0'; i++)
+				value[i] = line[i];
+			value[i] = '\0';
+			return;
+		}
+	}
+}
+
+int get_keep_alive_old(char request[]){
+	char connection_header[32], *end_of_line;
+	int http_1_1;
+
+	end_of_line = strchr(request, '\n');
+	http_1_1 = (end_of_line != NULL && end_of_line - request >= 8 && strncmp(end_of_line - ((end_of_line[-1] == '\r') ? 9 : 8), "HTTP/1.1", 8) == 0);
+	get_header_value_old(request, "Connection", connection_header, sizeof(connection_header));
+	if (strcasecmp(connection_header, "close") == 0)
+		return 0;
+	if (strcasecmp(connection_header, "keep-alive") == 0)
+		return 1;
+	return http_1_1;
+}
+
+volatile int sink;
+
+/* runs the old functions over a buffer which grows by step bytes at a time */
+double run_old(char buffer[], int length, int step){
+	char request_type[8], file_name[160], saved;
+	long long start = get_monotonic_ns();
+	int round, received, head_length;
+
+	for (round = 0; round < ROUNDS; round++){
+		head_length = 0;
+		for (received = step; head_length == 0; received += step){
+			if (received > length)
+				received = length;
+			saved = buffer[received];
+			buffer[received] = '\0';
+			head_length = find_request_head_end_old(buffer);
+			buffer[received] = saved;
+		}
+		get_request_type_old(buffer, request_type);
+		get_file_name_old(buffer, file_name);
+		sink += head_length + get_keep_alive_old(buffer) + file_name[0] + request_type[0];
+	}
+	return (double)(get_monotonic_ns() - start) / ROUNDS;
+}
+
+double run_new(char buffer[], int length, int step){
+	HttpRequest request;
+	char request_type[8], file_name[160];
+	long long start = get_monotonic_ns();
+	int round, received, result;
+
+	for (round = 0; round < ROUNDS; round++){
+		http_request_reset(&request);
+		result = PARSE_INCOMPLETE;
+		for (received = step; result == PARSE_INCOMPLETE; received += step){
+			if (received > length)
+				received = length;
+			result = parse_http_request(&request, buffer, received);
+		}
+		copy_slice(request_type, sizeof(request_type), &request.method);
+		get_file_name(&request.path, file_name);
+		sink += request.head_length + get_keep_alive(&request) + file_name[0] + request_type[0];
+	}
+	return (double)(get_monotonic_ns() - start) / ROUNDS;
+}
+
+int main(){
+	int length = strlen(browser_request);
+	double old_ns, new_ns;
+
+	printf("Request head : %d bytes, %d rounds, delimiter search : %s\n", length, ROUNDS,
+#if defined(__AVX2__)
+		"AVX2"
+#elif defined(__SSE2__)
+		"SSE2"
+#else
+		"scalar"
+#endif
+		);
+	printf("%-12s %14s %14s %12s %12s\n", "arrival", "old ns/req", "new ns/req", "old MB/s", "new MB/s");
+
+	old_ns = run_old(browser_request, length, length);
+	new_ns = run_new(browser_request, length, length);
+	printf("%-12s %14.1f %14.1f %12.1f %12.1f\n", "whole", old_ns, new_ns, length / old_ns * 1000, length / new_ns * 1000);
+
+	old_ns = run_old(browser_request, length, FRAGMENT_SIZE);
+	new_ns = run_new(browser_request, length, FRAGMENT_SIZE);
+	printf("%-12s %14.1f %14.1f %12.1f %12.1f\n", "fragmented", old_ns, new_ns, length / old_ns * 1000, length / new_ns * 1000);
+	return 0;
+}
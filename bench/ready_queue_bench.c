@@ -0,0 +1,108 @@
+/*
+ * READY QUEUE BENCHMARK : LOCK FREE READY RING AGAINST THE OLD MUTEX + CONDITION VARIABLE LIST
+ * Build with : make ready_queue_bench
+ * One producer feeds REQUESTS nodes to W workers. Serving a node is simulated by a short blocking
+ * sleep, the way a send to a client blocks. The old workers held ready_queue_mutex while serving,
+ * the new ones serve without any shared lock, so only the new design scales with W.
+ */
+#define MYHTTPD_NO_MAIN
+#include "../myhttpd_ketan.c"
+
+#define REQUESTS 4000
+#define SERVICE_NS 50000
+
+Node stop_nodes[64];
+Queue locked_queue = { NULL, NULL };
+pthread_mutex_t locked_queue_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t locked_queue_empty = PTHREAD_COND_INITIALIZER;
+
+void serve(){
+	struct timespec service = { 0, SERVICE_NS };
+
+	nanosleep(&service, NULL);
+}
+
+void *locked_worker(void *argument){
+	Node *node;
+
+	(void)argument;
+	while(1){
+		pthread_mutex_lock(&locked_queue_mutex);
+		while (locked_queue.front == NULL)
+			pthread_cond_wait(&locked_queue_empty, &locked_queue_mutex);
+		node = dequeue_using_FCFS(&locked_queue);
+		if (node >= stop_nodes && node < stop_nodes + 64){
+			pthread_mutex_unlock(&locked_queue_mutex);
+			return NULL;
+		}
+		serve();	/* the old worker_routine sent the response with the lock held */
+		pthread_mutex_unlock(&locked_queue_mutex);
+	}
+}
+
+void *ring_worker(void *argument){
+	Node *node;
+
+	(void)argument;
+	while(1){
+		node = dequeue_from_ready_queue(0);
+		if (node >= stop_nodes && node < stop_nodes + 64)
+			return NULL;
+		serve();
+	}
+}
+
+void locked_insert(Node *node){
+	pthread_mutex_lock(&locked_queue_mutex);
+	node -> next = NULL;
+	node -> previous = NULL;
+	insert_into_queue(&locked_queue, node);
+	pthread_cond_signal(&locked_queue_empty);
+	pthread_mutex_unlock(&locked_queue_mutex);
+}
+
+double run(int workers, int use_ring, Node *nodes){
+	pthread_t threads[64];	/* one stop node per worker, at most 64 workers */
+	struct timespec start, end;
+	int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < workers; i++)
+		pthread_create(&threads[i], NULL, use_ring ? ring_worker : locked_worker, NULL);
+	for (i = 0; i < REQUESTS; i++){
+		if (use_ring)
+			insert_into_ready_queue(&nodes[i]);
+		else
+			locked_insert(&nodes[i]);
+	}
+	for (i = 0; i < workers; i++){
+		if (use_ring)
+			insert_into_ready_queue(&stop_nodes[i]);
+		else
+			locked_insert(&stop_nodes[i]);
+	}
+	for (i = 0; i < workers; i++)
+		pthread_join(threads[i], NULL);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return REQUESTS / ((end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+}
+
+int main(){
+	int worker_counts[] = { 1, 2, 4, 8, 16 };
+	int i;
+	Node *nodes = (Node *)calloc(REQUESTS, sizeof(Node));
+	FILE *out;
+
+	/* the queue functions narrate on stdout : keep the results apart */
+	out = fdopen(dup(1), "w");
+	freopen("/dev/null", "w", stdout);
+	ready_ring_init(&ready_queue);
+
+	fprintf(out, "%8s %18s %18s\n", "workers", "locked req/s", "ring req/s");
+	for (i = 0; i < (int)(sizeof(worker_counts) / sizeof(worker_counts[0])); i++){
+		fprintf(out, "%8d %18.0f %18.0f\n", worker_counts[i], run(worker_counts[i], 0, nodes), run(worker_counts[i], 1, nodes));
+		fflush(out);
+	}
+	free(nodes);
+	return 0;
+}
@@ -0,0 +1,69 @@
+#!/bin/sh
+#
+# BENCHMARK SUITE : FCFS AGAINST SJF FOR SEVERAL WORKER COUNTS, OVER LOOPBACK
+# Run with : make bench
+#
+# A document root with a mix of small and large files is generated, myhttpd is started in the
+# foreground for every configuration and loadgen drives it. Every run appends one JSON line to
+# the results file so two versions can be compared line by line.
+#
+# Environment : PORT (default 18080), DURATION seconds per run (default 5), CONNECTIONS (default 32),
+# THREADS worker counts (default "1 2 4 8"), POLICIES (default "FCFS SJF"), KEEPALIVE (default "1 0"),
+# RATE requests per second for an open loop run (default 0 = closed loop), LISTENERS SO_REUSEPORT
+# listener threads (default 1), RESULTS file.
+
+cd "$(dirname "$0")/.." || exit 1
+
+PORT=${PORT:-18080}
+DURATION=${DURATION:-5}
+CONNECTIONS=${CONNECTIONS:-32}
+THREADS=${THREADS:-"1 2 4 8"}
+POLICIES=${POLICIES:-"FCFS SJF"}
+KEEPALIVE=${KEEPALIVE:-"1 0"}
+RATE=${RATE:-0}
+LISTENERS=${LISTENERS:-1}
+RESULTS=${RESULTS:-bench/results.jsonl}
+ROOT=$(mktemp -d /tmp/myhttpd-bench.XXXXXX)
+MIX="/small.html:70,/medium.html:20,/large.html:8,/huge.html:2"
+
+cleanup() {
+	[ -n "$SERVER" ] && kill "$SERVER" 2>/dev/null
+	rm -rf "$ROOT"
+}
+trap cleanup EXIT INT TERM
+
+# generated document root : 1 KB, 32 KB, 1 MB and 16 MB files
+head -c 1024 /dev/zero | tr '\0' 'a' > "$ROOT/small.html"
+head -c 32768 /dev/zero | tr '\0' 'b' > "$ROOT/medium.html"
+head -c 1048576 /dev/zero | tr '\0' 'c' > "$ROOT/large.html"
+head -c 16777216 /dev/zero | tr '\0' 'd' > "$ROOT/huge.html"
+
+: > "$RESULTS"
+for policy in $POLICIES; do
+	for threads in $THREADS; do
+		# -f keeps the server in the foreground without debug mode, -t 0 schedules right away
+		./myhttpd -f -p "$PORT" -r "$ROOT" -t 0 -n "$threads" -s "$policy" -L "$LISTENERS" > /dev/null 2>&1 &
+		SERVER=$!
+
+		# the workers start a few seconds after the listener : wait for the first response
+		tries=0
+		until ./bench/loadgen -p "$PORT" -c 1 -d 1 -m /small.html:1 2>/dev/null | grep -q '"requests":[1-9]'; do
+			tries=$((tries + 1))
+			if [ $tries -gt 20 ]; then
+				echo "myhttpd did not come up on port $PORT" >&2
+				exit 1
+			fi
+		done
+
+		for keep_alive in $KEEPALIVE; do
+			./bench/loadgen -p "$PORT" -c "$CONNECTIONS" -d "$DURATION" -R "$RATE" -k "$keep_alive" -m "$MIX" \
+				-L "policy=$policy,threads=$threads,listeners=$LISTENERS" | tee -a "$RESULTS"
+		done
+
+		kill "$SERVER"
+		wait "$SERVER" 2>/dev/null
+		SERVER=
+		PORT=$((PORT + 1))	# the old port may still be in TIME_WAIT
+	done
+done
+echo "Results written to $RESULTS"
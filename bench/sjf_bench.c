@@ -0,0 +1,145 @@
+/*
+ * SJF MICROBENCHMARK : HEAP BASED dequeue_using_SJF AGAINST THE OLD LINKED LIST WALK
+ * Build with : make sjf_bench
+ * Each round keeps the queue at a fixed depth : dequeue the shortest job and insert a new one.
+ * The server column goes through insert_into_waiting_queue and dequeue_from_waiting_queue with
+ * the listener lock taken, as the listener and the scheduler do.
+ */
+#define MYHTTPD_NO_MAIN
+#include "../myhttpd_ketan.c"
+
+/* the linked list walk dequeue_using_SJF used before the heap */
+Node *dequeue_using_SJF_list(Queue *queue){
+	Node *temp = NULL;
+	Node *iterator;
+			
+	if( (queue -> front != NULL) && (queue -> rear != NULL) && (queue -> front == queue -> rear) ){ /* If only one element exists */
+		temp = queue -> front;
+		queue -> front = NULL;
+		queue -> rear = NULL;
+	}
+	else{
+		iterator = queue -> front;
+		temp = iterator;
+		while (iterator != NULL){
+			if (temp -> file_size > iterator -> file_size){
+				temp = iterator;
+			}
+			iterator = iterator -> next;
+		}
+		if(temp == queue -> front){
+			queue -> front = temp -> next;
+		}
+		if(temp == queue -> rear){
+			queue -> rear = temp -> previous;
+		}
+		if(temp -> previous != NULL)
+			temp -> previous -> next = temp -> next;
+		if(temp -> next != NULL)
+			temp -> next -> previous = temp -> previous;
+		temp -> previous = NULL;
+		temp -> next = NULL;
+	}
+	return temp;
+}
+
+double elapsed_ns(struct timespec *start, struct timespec *end){
+	return (end -> tv_sec - start -> tv_sec) * 1e9 + (end -> tv_nsec - start -> tv_nsec);
+}
+
+void reset_node(Node *node){
+	node -> file_size = rand() % (1 << 20);
+	node -> sjf_key = node -> file_size;
+	node -> sequence = waiting_sequence++;
+	node -> next = NULL;
+	node -> previous = NULL;
+}
+
+int main(){
+	int depths[] = { 10, 100, 1000, 10000, 100000 };
+	int d, i, depth, rounds;
+	Node *nodes, *node;
+	Queue queue;
+	Heap heap = { NULL, 0, 0 };
+	Listener listener;
+	Connection connection;
+	struct timespec start, end;
+	double list_ns, heap_ns, server_ns;
+
+	memset(&listener, 0, sizeof(listener));
+	pthread_mutex_init(&listener.waiting_queue_mutex, NULL);
+	memset(&connection, 0, sizeof(connection));
+	connection.listener = &listener;
+
+	printf("%8s %10s %16s %16s %16s\n", "depth", "rounds", "list ns/op", "heap ns/op", "server ns/op");
+	for (d = 0; d < (int)(sizeof(depths) / sizeof(depths[0])); d++){
+		depth = depths[d];
+		rounds = 20000000 / depth;
+		if (rounds > 1000000)
+			rounds = 1000000;
+		if (rounds < 200)
+			rounds = 200;
+		nodes = (Node *)calloc(depth, sizeof(Node));
+
+		/* linked list walk */
+		srand(1);
+		queue.front = NULL;
+		queue.rear = NULL;
+		for (i = 0; i < depth; i++){
+			reset_node(&nodes[i]);
+			insert_into_queue(&queue, &nodes[i]);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (i = 0; i < rounds; i++){
+			node = dequeue_using_SJF_list(&queue);
+			reset_node(node);
+			insert_into_queue(&queue, node);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		list_ns = elapsed_ns(&start, &end) / rounds;
+
+		/* binary heap */
+		srand(1);
+		heap.size = 0;
+		for (i = 0; i < depth; i++){
+			reset_node(&nodes[i]);
+			insert_into_heap(&heap, &nodes[i]);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (i = 0; i < rounds; i++){
+			node = dequeue_using_SJF(&heap);
+			reset_node(node);
+			insert_into_heap(&heap, node);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		heap_ns = elapsed_ns(&start, &end) / rounds;
+
+		/* the server path : same heap, reached through the waiting queue of a listener */
+		srand(1);
+		use_SJF = 1;
+		listener.waiting_heap.size = 0;
+		for (i = 0; i < depth; i++){
+			reset_node(&nodes[i]);
+			nodes[i].connection = &connection;
+			insert_into_waiting_queue(&nodes[i]);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (i = 0; i < rounds; i++){
+			pthread_mutex_lock(&listener.waiting_queue_mutex);
+			node = dequeue_from_waiting_queue(&listener);
+			pthread_mutex_unlock(&listener.waiting_queue_mutex);
+			reset_node(node);
+			pthread_mutex_lock(&listener.waiting_queue_mutex);
+			insert_into_waiting_queue(node);
+			pthread_mutex_unlock(&listener.waiting_queue_mutex);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		server_ns = elapsed_ns(&start, &end) / rounds;
+
+		printf("%8d %10d %16.1f %16.1f %16.1f\n", depth, rounds, list_ns, heap_ns, server_ns);
+		free(nodes);
+	}
+	free(heap.nodes);
+	free(listener.waiting_heap.nodes);
+	return 0;
+}
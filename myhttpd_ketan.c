@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -7,28 +8,155 @@
 #include <sys/stat.h>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
 #include <inttypes.h>
+#include <stddef.h>
 #include <pthread.h>
 #include <dirent.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/sendfile.h>
+#include <sys/uio.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/prctl.h>
+#include <signal.h>
+#include <linux/futex.h>
+#include <limits.h>
+#include <zlib.h>
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#define HAVE_IO_URING
+#endif
+#endif
+#if defined(__SSE2__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
 
 /*
  * DIRECTORY STRUCTURE
  */
-char dir_root[200], custom_dir[200], tilde_root[200], tilde_user[20];
+char custom_dir[200];
+/* scratch space of the path resolution : every listener thread resolves its own requests */
+__thread char dir_root[200], tilde_root[200], tilde_user[20];
+__thread int tilde_present = 0;
+
+/*
+ * OBJECT POOLS : FIXED SIZE OBJECTS CARVED FROM SLABS AND RECYCLED THROUGH THREAD LOCAL FREE LISTS
+ * A thread only takes the pool lock once every POOL_BATCH allocations or frees, and slabs are never
+ * given back, so in steady state requests are handled without touching malloc
+ */
+#define POOL_BATCH 64
+#define POOL_SLAB_BYTES (256 * 1024)
+
+typedef struct pool_object {
+	struct pool_object *next;
+} PoolObject;
+
+typedef struct pool {
+	size_t object_size;
+	pthread_mutex_t mutex;
+	PoolObject *free_list;
+	long free_count, slabs;
+} Pool;
+
+typedef struct pool_cache {
+	PoolObject *free_list;
+	int count;
+} PoolCache;
+
+/*
+ * FILE METADATA : EVERYTHING A RESPONSE NEEDS TO KNOW ABOUT THE REQUESTED FILE
+ * header holds the lines of a 200 response which only depend on the file, ready to be sent
+ */
+#define HEADER_FRAGMENT_SIZE 320
+#define DATE_LINE_SIZE 48
+#define ETAG_SIZE 64
+
+typedef struct file_metadata {
+	int exists;
+	int is_directory;
+	long size;
+	time_t mtime;
+	ino_t inode;
+	int header_length;
+	char header[HEADER_FRAGMENT_SIZE];
+} FileMetadata;
+
+/*
+ * REQUEST STAGES : MONOTONIC NANOSECOND TIMESTAMPS TAKEN AS A REQUEST MOVES THROUGH THE SERVER
+ * Interval i runs from stage i to stage i + 1, the last interval covers the whole request
+ */
+#define STAGE_ACCEPTED 0	/* connection accepted, or the first bytes of a later request received */
+#define STAGE_PARSED 1		/* request head parsed and the file looked up */
+#define STAGE_ENQUEUED 2	/* inserted into the waiting queue */
+#define STAGE_DISPATCHED 3	/* taken out of the waiting queue by the scheduler */
+#define STAGE_DEQUEUED 4	/* picked up by a worker */
+#define STAGE_FIRST_BYTE 5	/* the worker starts sending the response */
+#define STAGE_LAST_BYTE 6	/* the last byte of the response has been sent */
+#define STAGE_COUNT 7
+#define INTERVAL_TOTAL (STAGE_COUNT - 1)
+#define INTERVAL_COUNT STAGE_COUNT
+
+/*
+ * A CLIENT WHICH TAKES NO BYTE OF ITS RESPONSE FOR SEND_TIMEOUT_MS IS DROPPED, SO IT CANNOT HOLD A WORKER FOREVER
+ */
+#define SEND_TIMEOUT_MS 30000
+
+/*
+ * BYTE RANGES OF A Range REQUEST, BOTH ENDS INCLUDED
+ */
+#define MAX_RANGES 8
+#define RANGE_PART_HEADER_SIZE 200
+#define MULTIPART_BOUNDARY "MYHTTPD_BYTERANGES_BOUNDARY"
+#define MULTIPART_END "\r\n--" MULTIPART_BOUNDARY "--\r\n"
+
+typedef struct byte_range {
+	long first;
+	long last;
+} ByteRange;
 
 /*
  * QUEUE NODE STRUCTURE
  */
 typedef struct node{
 	int acceptfd;
-	char file_name[20];
+	char file_name[160];
 	char file_path[200];
-	char request_type[5];
+	char request_type[8];
 	int file_size;	
 	char client_ip[20];
 	char content_type[15];
 	char arrival_time[30];
 	char current_dir[200];
+	int keep_alive;
+	int http_1_1;
+	int file_not_found;
+	int server_status;
+	int range_count;	/* 0 for the whole file, -1 when no range can be satisfied */
+	ByteRange ranges[MAX_RANGES];
+	char *content_encoding;	/* NULL for the identity encoding */
+	struct variant_entry *variant;
+	struct pack_entry *archive_entry;	/* the body is in the archive mapping */
+	int compress_pending;
+	int not_modified;	/* 304 : the client's copy is current, only a header goes out */
+	struct listing_entry *listing;
+	long long stage_ns[STAGE_COUNT];
+	long long sjf_key;
+	unsigned long sequence;
+	int worker_id;
+	struct cache_entry *cache_entry;
+	FileMetadata metadata;
+	int filefd;
+	struct connection *connection;
 	struct node *next;
 	struct node *previous;
 } Node;
@@ -40,22 +168,600 @@ typedef struct queue {
 	Node *front, *rear;
 } Queue;
 
-Queue waiting_queue = { NULL, NULL }, ready_queue = { NULL, NULL };
+/*
+ * WAITING HEAP FOR SJF AND EDF : BINARY MIN HEAP ON sjf_key, EQUAL KEYS LEAVE IN ARRIVAL ORDER
+ */
+typedef struct heap {
+	Node **nodes;
+	int size, capacity;
+} Heap;
+
+unsigned long waiting_sequence = 0;
+
+/*
+ * FAIR QUEUE FOR DRR : ONE FCFS SUB-QUEUE PER CLIENT IP, SERVED BY DEFICIT ROUND ROBIN ON BYTES
+ * Clients with requests waiting are chained in the active list. The client at its head earns
+ * drr_quantum bytes of credit per turn and is served while the next request fits in its credit,
+ * so a client pulling large files gets as many bytes as one asking for small ones, not more.
+ * A client leaves the table once its sub-queue is empty.
+ */
+#define CLIENT_BUCKETS 1024
+#define DRR_REQUEST_COST 1024	/* bytes charged on top of the body, so empty responses are not free */
+#define DRR_STATUS_CLIENTS 32	/* clients listed per listener in /server-status */
+
+typedef struct client_queue {
+	char client_ip[20];
+	Queue queue;
+	long backlog_requests;
+	long backlog_bytes;
+	long deficit;
+	int in_turn;
+	struct client_queue *hash_next, *active_next;
+} ClientQueue;
+
+typedef struct fair_queue {
+	ClientQueue *buckets[CLIENT_BUCKETS];
+	ClientQueue *active_head, *active_tail;
+	long size;
+	int clients;
+} FairQueue;
+
+long drr_quantum = 64 * 1024;
+
+/*
+ * READY QUEUE : BOUNDED LOCK FREE MULTI PRODUCER / MULTI CONSUMER RING
+ * Every slot carries a sequence number telling whether it is free for the producer of a given lap
+ * or holds a node for the consumer of that lap, so push and pop only race on one compare and swap
+ */
+#define READY_RING_SIZE 1024	/* must be a power of 2 */
+
+typedef struct ready_slot {
+	unsigned long sequence;
+	Node *node;
+} ReadySlot;
+
+/*
+ * PARKING SPOT : THREADS SLEEP ON A FUTEX WORD WHICH IS BUMPED ON EVERY WAKE UP
+ */
+typedef struct parking {
+	int word;
+	int sleepers;
+} Parking;
+
+typedef struct ready_ring {
+	ReadySlot slots[READY_RING_SIZE];
+	unsigned long enqueue_position __attribute__((aligned(64)));
+	unsigned long dequeue_position __attribute__((aligned(64)));
+	Parking not_empty __attribute__((aligned(64)));
+	Parking not_full;
+} ReadyRing;
+
+ReadyRing ready_queue;
+
+/*
+ * WORKER QUEUES FOR WORK STEALING DISPATCH (-w)
+ * The listener pushes requests onto the inbox of the worker chosen by the scheduling policy.
+ * The worker moves its inbox, ordered by the policy, onto a Chase-Lev deque : the owner pops
+ * the next job from the bottom while idle workers steal the job the owner would run last from the top.
+ */
+#define WORKER_DEQUE_SIZE 4096	/* must be a power of 2 */
+
+typedef struct worker_queue {
+	Node *inbox __attribute__((aligned(64)));
+	long top __attribute__((aligned(64)));
+	long bottom __attribute__((aligned(64)));
+	Node *deque[WORKER_DEQUE_SIZE];
+	Node **batch;
+	int batch_capacity;
+	long queued_count, queued_bytes;
+	Parking parking;
+} WorkerQueue;
+
+WorkerQueue *worker_queues = NULL;
+unsigned long next_worker = 0;
+
+/*
+ * FILE CONTENT CACHE (-c) : HOT FILES KEPT IN MEMORY, KEYED BY THE RESOLVED FILE PATH
+ * The cache is split into shards, each with its own lock, hash table and CLOCK ring.
+ * Entries are reference counted so that eviction never frees a body that is still being sent.
+ */
+#define CACHE_SHARDS 16
+#define CACHE_BUCKETS 1024
+#define MAX_CACHE_WATCHES 256
+
+typedef struct cache_entry {
+	char file_path[200];
+	unsigned long hash;
+	char *content;
+	long size;
+	time_t mtime;
+	ino_t inode;
+	time_t checked;
+	int unwatched;	/* no inotify watch covers the file : revalidated with stat like without inotify */
+	int header_length;
+	char header[HEADER_FRAGMENT_SIZE];
+	int references;
+	int referenced;
+	struct cache_entry *hash_next;
+	struct cache_entry *clock_next, *clock_previous;
+} CacheEntry;
+
+typedef struct cache_shard {
+	pthread_mutex_t mutex;
+	CacheEntry *buckets[CACHE_BUCKETS];
+	CacheEntry *clock_hand;
+	long used_bytes;
+} CacheShard;
+
+typedef struct cache_watch {
+	int watch;
+	char prefix[200];
+} CacheWatch;
+
+CacheShard cache_shards[CACHE_SHARDS];
+CacheWatch cache_watches[MAX_CACHE_WATCHES];
+int cache_watch_count = 0, inotify_fd = -1;
+long cache_capacity = 0;
+unsigned long cache_hits = 0, cache_misses = 0, cache_evictions = 0, cache_invalidations = 0, cache_generation = 0;
+
+/*
+ * ACCESS LOG (-l) : EVERY THREAD THAT LOGS OWNS A SINGLE PRODUCER / SINGLE CONSUMER RING OF RECORDS
+ * A background writer drains all rings into large batched writes, so request threads never touch the file
+ */
+#define LOG_RECORD_SIZE 512
+#define LOG_RING_RECORDS 1024
+#define MAX_LOG_RINGS 256
+
+typedef struct log_ring {
+	unsigned long head __attribute__((aligned(64)));
+	unsigned long tail __attribute__((aligned(64)));
+	unsigned long dropped;
+	char records[LOG_RING_RECORDS][LOG_RECORD_SIZE];
+} LogRing;
+
+LogRing *log_rings[MAX_LOG_RINGS];
+__thread LogRing *log_ring = NULL;
+int log_ring_count = 0, log_fd = -1, log_flush_size = 64 * 1024;
+long long log_flush_interval = 1000;
+long log_rotate_size = 0, log_file_size = 0;
+time_t log_rotate_interval = 0, log_opened_at;
+unsigned long log_records_dropped = 0;
+Parking log_writer_parking;
+
+/*
+ * STAGE HISTOGRAMS : EVERY THREAD THAT SERVES REQUESTS OWNS ONE HISTOGRAM PER INTERVAL
+ * They are merged only when /server-status is requested
+ */
+#define HISTOGRAM_SUB_BUCKETS 16
+#define HISTOGRAM_BUCKETS 1024
+#define MAX_STAGE_HISTOGRAMS 256
+#define STATUS_BUFFER_SIZE (64 * 1024)
+
+typedef struct stage_histograms {
+	unsigned long buckets[INTERVAL_COUNT][HISTOGRAM_BUCKETS];
+	unsigned long long sum_ns[INTERVAL_COUNT];
+} StageHistograms;
+
+StageHistograms *stage_histograms_list[MAX_STAGE_HISTOGRAMS];
+__thread StageHistograms *stage_histograms = NULL;
+int stage_histograms_count = 0;
+unsigned long long *worker_busy_ns = NULL;
+long waiting_queue_length = 0;
+long long server_started_ns;
+
+/*
+ * ADMISSION CONTROL : -q CAPS THE REQUESTS ADMITTED AND NOT YET ANSWERED, -D GIVES EVERY REQUEST A DEADLINE
+ * Past the cap a request is refused with 503 before its file is even looked up. A request still
+ * waiting for a worker when its deadline passes is answered 503 too, without any file I/O, so that
+ * an overload costs the clients a retry instead of a queue which only grows.
+ */
+#define RESPONSE_SERVICE_UNAVAILABLE "HTTP/1.1 503 Service Unavailable\nRetry-After: 1\nContent-Length: 0\nConnection: close\n\n"
+
+long admitted_requests = 0, admission_cap = 0;
+long long request_deadline_ms = 0;
+unsigned long requests_shed_full = 0, requests_shed_expired = 0;
+
+/*
+ * FILE METADATA CACHE (-m) : RESULTS OF get_file_metadata, INCLUDING MISSING FILES, KEPT FOR A SHORT TIME
+ * Shards are guarded by read write locks so that workers and the listener look up concurrently
+ */
+#define METADATA_SHARDS 16
+#define METADATA_BUCKETS 1024
+#define METADATA_SHARD_ENTRIES 4096
+
+typedef struct metadata_entry {
+	char file_path[200];
+	unsigned long hash;
+	FileMetadata metadata;
+	long long expires;
+	struct metadata_entry *next;
+} MetadataEntry;
+
+typedef struct metadata_shard {
+	pthread_rwlock_t lock;
+	MetadataEntry *buckets[METADATA_BUCKETS];
+	int count;
+} MetadataShard;
+
+MetadataShard metadata_shards[METADATA_SHARDS];
+long long metadata_ttl = 1000;
+
+/*
+ * DIRECTORY LISTING CACHE : THE 404 PAGE LISTING A DIRECTORY, BUILT ONCE AND SHARED UNTIL THE DIRECTORY CHANGES
+ * Listings larger than LISTING_CACHE_MAX_BYTES are not kept but streamed with chunked encoding
+ */
+#define LISTING_BUCKETS 256
+#define LISTING_CACHE_ENTRIES 1024
+#define LISTING_CACHE_MAX_BYTES (1024 * 1024)
+#define LISTING_CHUNK_SIZE (16 * 1024)
+#define LISTING_PREFIX "<html><body><h2>404 : File not found !</h2><h4>Contnet in the current directory is : </h4>"
+#define LISTING_SUFFIX "</body></html>"
+
+typedef struct listing_entry {
+	char directory[200];
+	unsigned long hash;
+	char *content;
+	long length;
+	struct timespec mtime;
+	time_t checked;
+	int references;
+	struct listing_entry *next;
+} ListingEntry;
+
+ListingEntry *listing_buckets[LISTING_BUCKETS];
+int listing_count = 0;
+
+/*
+ * PARSED REQUEST HEAD : METHOD, PATH, VERSION AND HEADERS AS SLICES OF THE CONNECTION'S RECEIVE BUFFER
+ * The scan position is kept so that parsing resumes after a partial read
+ */
+#define MAX_REQUEST_HEADERS 64
+#define MAX_METHOD_LENGTH 7
+#define MAX_PATH_LENGTH 150
+#define PARSE_INCOMPLETE 0
+#define PARSE_COMPLETE 1
+#define PARSE_ERROR -1
+#define RESPONSE_BAD_REQUEST "HTTP/1.1 400 Bad Request\nContent-Length: 0\nConnection: close\n\n"
+#define RESPONSE_URI_TOO_LONG "HTTP/1.1 414 URI Too Long\nContent-Length: 0\nConnection: close\n\n"
+#define RESPONSE_HEADERS_TOO_LARGE "HTTP/1.1 431 Request Header Fields Too Large\nContent-Length: 0\nConnection: close\n\n"
+
+typedef struct slice {
+	char *start;
+	int length;
+} Slice;
+
+typedef struct http_header {
+	Slice name;
+	Slice value;
+} HttpHeader;
+
+typedef struct http_request {
+	int scanned;		/* bytes already searched for a newline */
+	int line_start;		/* start of the line being received */
+	int request_line_done;
+	int head_length;
+	char *error;		/* canned response for a refused head */
+	Slice method, path, query, version;
+	int header_count;
+	HttpHeader headers[MAX_REQUEST_HEADERS];
+} HttpRequest;
+
+/*
+ * VARIANT CACHE (-z) : GZIP COMPRESSED COPIES OF TEXT FILES, MADE ON THE FIRST REQUEST WHICH ACCEPTS THEM
+ * Bounded in bytes, least recently used variants go first. Precompressed .br/.zst/.gz siblings
+ * in the document root are preferred and never enter this cache.
+ */
+#define ENCODING_GZIP 1
+#define ENCODING_BR 2
+#define ENCODING_ZSTD 4
+#define VARIANT_BUCKETS 1024
+#define MIN_COMPRESS_SIZE 256
+
+typedef struct variant_entry {
+	char file_path[200];
+	unsigned long hash;
+	time_t mtime;
+	long original_size;
+	char *content;
+	long length;	/* -1 when compression did not pay off */
+	int references;
+	struct variant_entry *hash_next;
+	struct variant_entry *lru_next, *lru_previous;
+} VariantEntry;
+
+VariantEntry *variant_buckets[VARIANT_BUCKETS], *variant_lru_head = NULL, *variant_lru_tail = NULL;
+long variant_capacity = 16 * 1024 * 1024, variant_used_bytes = 0;
+int compression_level = 6;
+
+/*
+ * STATIC ASSET ARCHIVE (-x) : A DOCUMENT ROOT PACKED BY myhttpd_pack INTO ONE FILE, SERVED FROM A READ ONLY MAPPING
+ * Layout : a PackHeader, bucket_count bucket heads, entry_count entries, then the file bodies at data_offset.
+ * A bucket holds the index of the first entry of its chain, entries chain through next and -1 ends a chain.
+ * Every entry carries the header fragment of its file, so a packed file needs no syscall before the send.
+ * Paths missing from the archive are still looked up in the document root.
+ */
+#define PACK_MAGIC "MYHPACK1"
+#define PACK_ALIGNMENT 64
+
+typedef struct pack_header {
+	char magic[8];
+	int bucket_count;	/* a power of 2 */
+	int entry_count;
+	long data_offset;
+} PackHeader;
+
+typedef struct pack_entry {
+	char file_path[160];	/* relative to the document root, as in the request */
+	unsigned long hash;
+	int next;
+	int header_length;
+	long offset;	/* of the body, from the start of the archive */
+	long size;
+	time_t mtime;
+	ino_t inode;
+	char content_type[15];
+	char header[HEADER_FRAGMENT_SIZE];
+} PackEntry;
+
+char *archive_base = NULL, *archive_file_name = NULL;
+PackHeader *archive_header = NULL;
+int *archive_buckets = NULL, archive_prefetch = 0;
+PackEntry *archive_entries = NULL;
+
+/*
+ * CONNECTION STRUCTURE : A CLIENT SOCKET AND THE REQUEST HEADS RECEIVED ON IT
+ * A connection is either READING (owned by the listener and kept in the idle list)
+ * or QUEUED (its current request is in the queues and a worker owns it)
+ */
+#define REQUEST_HEAD_SIZE 8192
+#define MAX_EPOLL_EVENTS 256
+#define CONNECTION_READING 0
+#define CONNECTION_QUEUED 1
+#define CONNECTION_CLOSING 2	/* io_uring : shut down while its recv is in flight, freed when that completes */
+
+typedef struct connection{
+	struct listener *listener;
+	int fd;
+	char client_ip[20];
+	int state;
+	int length;
+	int head_length;
+	HttpRequest request;
+	long long request_start_ns;
+	time_t last_active;
+	struct connection *next;
+	struct connection *previous;
+	struct connection *rearm_next;
+	char buffer[REQUEST_HEAD_SIZE + 1];
+} Connection;
+
+/*
+ * IO_URING BACKEND (-u) : THE LISTENER LOOP ON ONE io_uring PER LISTENER INSTEAD OF EPOLL
+ * Accept is multishot and every recv lands straight in the connection's head buffer, so a round of
+ * the loop is a single io_uring_enter however many connections it serves. Built from the kernel's
+ * own header without liburing, and a kernel which refuses the ring leaves the listener on epoll.
+ */
+#define URING_ENTRIES 4096
+#define URING_ACCEPT 1	/* user data of the completions which are not a connection */
+#define URING_WAKEUP 2
+#define URING_TIMEOUT 3
+#define URING_PROBE 4
+
+typedef struct uring {
+	int fd;
+	unsigned *sq_head, *sq_tail, *sq_array, sq_mask, sq_entries, pending;
+	struct io_uring_sqe *sqes;
+	unsigned *cq_head, *cq_tail, cq_mask;
+	struct io_uring_cqe *cqes;
+	char *sq_ring;
+	size_t sq_ring_size, sqes_size;
+} Uring;
+
+int use_io_uring = 0;
+
+/*
+ * LISTENER : ONE ACCEPT AND READ THREAD WITH ITS OWN SO_REUSEPORT SOCKET, EPOLL INSTANCE AND WAITING QUEUE
+ * With -L the kernel spreads new connections over the listeners. Every listener has its own scheduler
+ * draining its waiting queue into the shared ready ring, so listeners never contend on one lock.
+ * The idle list holds the connections of this listener which are in the read path.
+ */
+typedef struct listener {
+	int id;
+	int sockfd;
+	int epollfd;
+	pthread_t thread, scheduler;
+	pthread_mutex_t waiting_queue_mutex;
+	pthread_cond_t waiting_queue_empty;
+	Queue waiting_queue;
+	Heap waiting_heap;
+	FairQueue fair_queue;
+	pthread_mutex_t idle_connections_mutex;
+	Connection *idle_connections;
+	Uring *ring;	/* NULL on the epoll backend */
+	int wakeup_fd;
+	unsigned long wakeup_count;
+	Connection *rearm_stack;
+	int accept_deferred;	/* -j : new connections are left to a less loaded process */
+} Listener;
+
+Listener *listeners = NULL;
+int listener_count = 1, pin_listeners = 0;
+
+/*
+ * PREFORK (-j) : A MASTER BINDS THE SOCKETS, FORKS THE WORKER PROCESSES AND RESTARTS THE ONES WHICH DIE
+ * Every child runs the whole listener, scheduler and worker pipeline on the inherited sockets, so
+ * nothing but the kernel accept queue is shared between them. The master maps one shared page of
+ * counters before forking : each child publishes its queue depth there, and a child which holds
+ * more requests than the least loaded one plus ACCEPT_SLACK leaves new connections to the others.
+ */
+#define MAX_PROCESSES 64
+#define ACCEPT_SLACK 4
+#define ACCEPT_DEFER_MS 2
+
+typedef struct shared_child {
+	pid_t pid;
+	long queue_depth;
+	unsigned long requests;
+	unsigned long bytes;
+	unsigned long restarts;
+	long long started_ns;
+} SharedChild;
+
+typedef struct shared_stats {
+	int process_count;
+	unsigned long restarts;
+	SharedChild children[MAX_PROCESSES];
+} SharedStats;
+
+SharedStats *shared_stats = NULL;
+SharedChild *shared_child = NULL;	/* NULL in a single process server */
+int prefork_count = 0, process_index = 0;
+
+/*
+ * WORKER POOL : BETWEEN -n AND -N WORKERS, RESIZED BY THE POOL MANAGER FROM THE QUEUE DEPTH AND BUSY TIME
+ * Workers 0 .. pool_target - 1 run. A worker whose id reaches pool_target leaves, handing its
+ * log ring and histograms to its slot so that the next worker started in the slot keeps them.
+ * The decision to leave is taken under the mutex of the slot, so the pool manager growing the
+ * pool again either keeps a worker which has not left yet or starts a new one after it left.
+ */
+#define POOL_INTERVAL_MS 100
+#define POOL_SHRINK_INTERVALS 50	/* 5 idle seconds give one worker back */
+#define POOL_GROW_BUSY 0.85
+#define POOL_SHRINK_BUSY 0.25
+#define AFFINITY_NONE 0
+#define AFFINITY_CPU 1
+#define AFFINITY_NODE 2
+
+typedef struct worker_slot {
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	int started, leaving;
+	struct log_ring *log_ring;
+	struct stage_histograms *histograms;
+} WorkerSlot;
+
+WorkerSlot *worker_slots = NULL;
+int worker_max = 0, pool_target = 1 << 30, worker_affinity = AFFINITY_NONE;
+unsigned long pool_grow_events = 0, pool_shrink_events = 0;
+
+Pool node_pool = { sizeof(Node), PTHREAD_MUTEX_INITIALIZER, NULL, 0, 0 };
+Pool client_queue_pool = { sizeof(ClientQueue), PTHREAD_MUTEX_INITIALIZER, NULL, 0, 0 };
+__thread PoolCache client_queue_pool_cache = { NULL, 0 };
+Pool connection_pool = { sizeof(Connection), PTHREAD_MUTEX_INITIALIZER, NULL, 0, 0 };
+__thread PoolCache node_pool_cache = { NULL, 0 }, connection_pool_cache = { NULL, 0 };
 
 /*
  * FUNCTION DECLARATION 
  */
 void usage();
 void parse_input();
-void listener_routine(void *sock_server);
-void scheduler_routine();
-void worker_routine();
-void parse_request(char request[], int acceptfd, char client_ip[]);
+void listener_routine(void *listener_argument);
+void scheduler_routine(void *listener_argument);
+int create_listening_socket(int reuse_port);
+void pin_to_cpu(int cpu);
+void prefork_master();
+int spawn_child(int index);
+int accept_is_deferred();
+void worker_routine(void *worker_number);
+int parse_request(Connection *connection);
+void accept_connections(Listener *listener);
+int read_request_head(Connection *connection);
+int request_head_received(Connection *connection, int received);
+Connection *setup_connection(Listener *listener, int acceptfd, struct sockaddr_in *client);
+#ifdef HAVE_IO_URING
+int uring_init(Uring *ring, unsigned entries);
+void uring_release(Uring *ring);
+int uring_probe_accept_multishot(Uring *ring);
+struct io_uring_sqe *uring_get_sqe(Uring *ring);
+int uring_enter(Uring *ring, unsigned wait_count);
+void uring_submit_recv(Listener *listener, Connection *connection);
+void uring_submit_accept(Listener *listener);
+void uring_submit_wakeup_read(Listener *listener);
+void uring_submit_timeout(Listener *listener);
+int uring_listener_init(Listener *listener);
+void uring_listener_loop(Listener *listener);
+#endif
+int parse_http_request(HttpRequest *request, char *buffer, int length);
+int parse_request_line(HttpRequest *request, char *line, int length);
+int parse_header_line(HttpRequest *request, char *line, int length);
+static inline int find_byte(char *data, int length, char byte);
+void http_request_reset(HttpRequest *request);
+Slice *get_header(HttpRequest *request, char header_name[]);
+void copy_slice(char destination[], int size, Slice *slice);
+void reject_request(Connection *connection, char *response);
+int get_keep_alive(HttpRequest *request);
+int get_http_1_1(HttpRequest *request);
+void get_header_value(HttpRequest *request, char header_name[], char value[], int value_size);
+void finish_request(Node *node);
+void rearm_connection(Connection *connection);
+void add_idle_connection(Connection *connection);
+void remove_idle_connection(Connection *connection);
+void close_idle_connections(Listener *listener);
+void close_connection(Connection *connection);
 Node *create_queue_node(int acceptfd, char request_type[], char file_name[], char client_ip[], int file_size, char file_path[], char content_type[], char current_dir[]);
 int insert_into_queue(Queue *queue, Node *new_node);
+int insert_into_fair_queue(FairQueue *fair_queue, Node *new_node);
+Node *dequeue_using_DRR(FairQueue *fair_queue);
 void display_queue(Queue *queue, char *queue_type);
 void print_node(Node *node);
-Node *dequeue_using_SJF(Queue *queue);
+Node *dequeue_using_SJF(Heap *heap);
+int insert_into_heap(Heap *heap, Node *new_node);
+int heap_node_before(Node *first, Node *second);
+void display_heap(Heap *heap, char *queue_type);
+int insert_into_waiting_queue(Node *new_node);
+Node *dequeue_from_waiting_queue(Listener *listener);
+void enqueue_request(Node *new_node);
+int waiting_queue_is_empty(Listener *listener);
+long long get_monotonic_ms();
+long long get_monotonic_ns();
+void record_request_stages(Node *node);
+int histogram_bucket(long long value);
+long long histogram_bucket_value(int bucket);
+int build_server_status(char buffer[], int size);
+void ready_ring_init(ReadyRing *ring);
+int ready_ring_push(ReadyRing *ring, Node *new_node);
+Node *ready_ring_pop(ReadyRing *ring);
+void insert_into_ready_queue(Node *new_node);
+void wait_for_ready_slot();
+Node *dequeue_from_ready_queue(int worker_id);
+void park(Parking *parking, int word);
+void unpark(Parking *parking);
+void unpark_all(Parking *parking);
+int worker_leaves(int worker_id);
+void start_worker(int worker_id);
+void retire_worker();
+void pool_manager_routine();
+void place_worker(int worker_id);
+void park_timeout(Parking *parking, int word, long long milliseconds);
+void log_record(char record[]);
+void log_writer_routine();
+void write_log_batch(char batch[], int length);
+void open_log_file();
+void dispatch_to_worker(Node *new_node);
+Node *dequeue_from_worker_queue(int worker_id);
+int worker_deque_push(WorkerQueue *worker_queue, Node *new_node);
+Node *worker_deque_pop(WorkerQueue *worker_queue);
+Node *worker_deque_steal(WorkerQueue *worker_queue);
+int refill_worker_deque(WorkerQueue *worker_queue);
+Node *steal_from_workers(int worker_id);
+int work_is_available(int worker_id);
+int compare_nodes(const void *first, const void *second);
+CacheEntry *cache_lookup(char file_path[]);
+CacheEntry *cache_fill(char file_path[]);
+CacheEntry *cache_find_entry(CacheShard *shard, char file_path[], unsigned long hash);
+void cache_remove_entry(CacheShard *shard, CacheEntry *entry);
+void cache_release(CacheEntry *entry);
+void cache_invalidate(char file_path[]);
+void cache_flush();
+int cache_watch_directory(char file_path[]);
+void cache_watch_routine();
+unsigned long hash_string(char *string);
+void display_cache_statistics();
+void format_timestamp(time_t timestamp, char formatted[]);
+void format_http_date(time_t timestamp, char formatted[]);
+void get_cached_date(char date_line[]);
+int build_header_fragment(char header[], char file_path[], long size, time_t mtime, ino_t inode);
+int send_iovec(int sockfd, struct iovec *iov, int iov_count, int more);
 Node *dequeue_using_FCFS(Queue *queue);
 
 char *get_http_status(Node *node, char http_status[]);
@@ -63,48 +769,107 @@ void get_current_time(char current_timestamp[]);
 void get_last_modified_time_of_file(char last_modified[], Node *removed_node);
 
 
-void get_request_type(char request[], char request_type[]);
 void get_file_path(char file_path[], char file_name[], char current_dir[]);
 void get_content_type(char content_type[], char file_name[]);
-long int get_file_size(char file_path[]);
-void get_file_name(char request[], char file_name[]);
+int get_file_metadata(char file_path[], FileMetadata *metadata, int keep_open);
+int metadata_cache_lookup(char file_path[], FileMetadata *metadata);
+void metadata_cache_insert(char file_path[], FileMetadata *metadata);
+void get_file_name(Slice *path, char file_name[]);
 void append_to_log_file(char client_ip[], char arrival_time[], char current_timestamp[], char first_line_of_request[], char *http_status, char char_file_size[]);
-void add_directory_content(char *buffer, Node *node);
+ListingEntry *get_directory_listing(char directory[]);
+void release_directory_listing(ListingEntry *entry);
+int stream_directory_listing(int sockfd, char directory[], int chunked);
+int send_listing_chunk(int sockfd, char chunk[], int length, int chunked);
+int send_all(int sockfd, char *buffer, size_t length);
+int wait_until_writable(int sockfd);
+int send_file_content(int sockfd, int filefd, char file_path[], long offset, long length);
+int parse_byte_ranges(Slice *header, long size, ByteRange ranges[]);
+int if_range_matches(HttpRequest *request, FileMetadata *metadata);
+int build_range_header(char header[], int size, Node *node, char http_status[], long *content_length);
+int format_range_part_header(char part_header[], Node *node, int i);
+int send_ranges(Node *node);
+int get_accepted_encodings(HttpRequest *request);
+int is_compressible(char content_type[]);
+void choose_content_encoding(Node *node, int accepted);
+void set_content_encoding(Node *node, char *encoding, long size);
+VariantEntry *variant_lookup(char file_path[], FileMetadata *metadata);
+VariantEntry *variant_fill(Node *node);
+void variant_remove_entry(VariantEntry *entry);
+void variant_link_lru(VariantEntry *entry);
+void variant_unlink_lru(VariantEntry *entry);
+void variant_release(VariantEntry *entry);
+int format_etag(char etag[], ino_t inode, long size, time_t mtime, char *encoding);
+int etag_list_matches(Slice *header, char etag[], int weak);
+time_t parse_http_date(Slice *header);
+int is_not_modified(HttpRequest *request, Node *node, char etag[]);
+int archive_open(char archive_path[]);
+int archive_is_valid(char *base, long size);
+PackEntry *archive_lookup(char file_path[]);
+void *pool_alloc(Pool *pool, PoolCache *cache);
+void pool_free(Pool *pool, PoolCache *cache, void *released);
+void pool_flush(Pool *pool, PoolCache *cache);
+void free_queue_node(Node *node);
+void release_node_resources(Node *node);
 
 /* 
  * GLOBAL VARIABLES
  */
-int port_number = 8080, THREADNUM = 4, SLEEP_TIME = 60;
+int port_number = 8080, THREADNUM = 4, SLEEP_TIME = 60, listen_backlog = 1024, keep_alive_timeout = 15;
 int help_flag = 0, dir_flag = 0;
-char *host = NULL, *port = NULL, *dir, log_file_name[10];
+char *host = NULL, *port = NULL, *dir, log_file_name[200];
 extern char *optarg;
 extern int optopt;
-int use_SJF = 0, create_log = 0, tilde_present = 0, custom_root_dir = 0, file_not_found = 0, debug = 0;
+long long sjf_aging = 0;
+int use_SJF = 0, use_EDF = 0, use_DRR = 0, work_stealing = 0, create_log = 0, custom_root_dir = 0, debug = 0, foreground = 0;
 
 
 /* 
  * MUTEX AND CONDITION VARIABLE DECLARATION
  */
-pthread_mutex_t waiting_queue_mutex;
-pthread_mutex_t ready_queue_mutex;
-pthread_cond_t waiting_queue_empty, ready_queue_empty;
+pthread_mutex_t log_rings_mutex;
+pthread_mutex_t cache_watch_mutex;
+pthread_mutex_t stage_histograms_mutex;
+pthread_mutex_t listing_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t variant_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t cached_date_mutex = PTHREAD_MUTEX_INITIALIZER;
+char cached_date_line[DATE_LINE_SIZE];
+time_t cached_date_second = 0;
+unsigned long cached_date_sequence = 0;
 
 /*
  * MAIN METHOD BEGINS
  */
+#ifndef MYHTTPD_NO_MAIN
 int main(int argc, char *argv[]){
-	int sock_server, i;
-	struct sockaddr_in server;
-	pthread_t listener, scheduler, worker[10];
+	int i, queuing_delay;
+	pthread_t pool_manager, cache_watcher, log_writer;
 
 	/* Initialize mutex and condition variable objects */
-	pthread_mutex_init(&waiting_queue_mutex, NULL);
-	pthread_mutex_init(&ready_queue_mutex, NULL);
-	pthread_cond_init(&waiting_queue_empty, NULL);
-	pthread_cond_init(&ready_queue_empty, NULL);
+	pthread_mutex_init(&log_rings_mutex, NULL);
+	pthread_mutex_init(&cache_watch_mutex, NULL);
+	pthread_mutex_init(&stage_histograms_mutex, NULL);
+	for (i = 0; i < CACHE_SHARDS; i++)
+		pthread_mutex_init(&cache_shards[i].mutex, NULL);
+	for (i = 0; i < METADATA_SHARDS; i++)
+		pthread_rwlock_init(&metadata_shards[i].lock, NULL);
+	ready_ring_init(&ready_queue);
 	
 	/* Parse the attributes provided to the program */
 	parse_input(argc, argv);
+	if (worker_max < THREADNUM || debug)
+		worker_max = THREADNUM;
+	if (work_stealing && worker_max > THREADNUM){
+		/* requests already sit in the deques of particular workers : that pool stays at -n */
+		printf("Work stealing keeps the pool at %d workers, -N is ignored\n", THREADNUM);
+		worker_max = THREADNUM;
+	}
+	if (work_stealing)
+		worker_queues = (WorkerQueue *)calloc(THREADNUM, sizeof(WorkerQueue));
+	worker_busy_ns = (unsigned long long *)calloc(worker_max, sizeof(unsigned long long));
+	worker_slots = (WorkerSlot *)calloc(worker_max, sizeof(WorkerSlot));
+	for (i = 0; i < worker_max; i++)
+		pthread_mutex_init(&worker_slots[i].mutex, NULL);
+	server_started_ns = get_monotonic_ns();
 	
 	if (help_flag == 1){
 		usage();
@@ -118,67 +883,110 @@ int main(int argc, char *argv[]){
 		}
 	}
 
-	/* setup server */ 
-	server.sin_family = AF_INET;
-	server.sin_addr.s_addr	= INADDR_ANY;
-	server.sin_port = htons(port_number);
- 	printf("Listening on port : %d\n", port_number);	
-
-	/* create socket on local host */
-	sock_server = socket(AF_INET, SOCK_STREAM, 0);
-	if (sock_server < 0){
-		perror("Error creating socket for server\n");
+	/* map the archive before any listener can ask it for a file */
+	if (archive_file_name != NULL && archive_open(archive_file_name) < 0)
 		exit(1);
+
+	/* setup server : one socket per listener, all bound to the same port when there are several */
+ 	printf("Listening on port : %d with %d listener(s)\n", port_number, listener_count);
+	listeners = (Listener *)calloc(listener_count, sizeof(Listener));
+	for (i = 0; i < listener_count; i++){
+		listeners[i].id = i;
+		listeners[i].sockfd = create_listening_socket(listener_count > 1);
+		pthread_mutex_init(&listeners[i].waiting_queue_mutex, NULL);
+		pthread_cond_init(&listeners[i].waiting_queue_empty, NULL);
+		pthread_mutex_init(&listeners[i].idle_connections_mutex, NULL);
 	}
-	//printf("Socket for server created successfully. It is : %d\n", sock_server);
 
-	/* call bind */
-	if ( bind(sock_server, (struct sockaddr *) &server, sizeof(server)) < 0 ){
-		perror("Bind for server failed.\n");
-		exit(1);
+	/* -j : from here on every child runs its own threads, the master only watches them */
+	if (prefork_count > 0){
+		prefork_master();
+		if (create_log)
+			sprintf(log_file_name + strlen(log_file_name), ".%d", process_index);
 	}
 
-	/* create listener thread */
-	if( pthread_create(&listener, NULL, (void *) &listener_routine, (void *) &sock_server) != 0){
-		perror("Error creating the listener thread\n");
+	/* create the inotify thread which keeps the content cache coherent, otherwise entries are revalidated with stat */
+	if (cache_capacity > 0){
+		inotify_fd = inotify_init1(IN_CLOEXEC);
+		if (inotify_fd < 0)
+			perror("inotify unavailable, the cache falls back to mtime checks");
+		else if (pthread_create(&cache_watcher, NULL, (void *) &cache_watch_routine, NULL) != 0)
+			perror("Error creating the cache watch thread\n");
 	}
 
-	/* create scheduler thread */
-	sleep(SLEEP_TIME);
-	if( pthread_create(&scheduler, NULL, (void *) &scheduler_routine, NULL) != 0){
-		perror("Error creating the scheduler thread\n");
+	/* create the access log writer */
+	if (create_log){
+		open_log_file();
+		if (pthread_create(&log_writer, NULL, (void *) &log_writer_routine, NULL) != 0)
+			perror("Error creating the log writer thread\n");
 	}
 
-	/* #TODO create worker threads */
-	sleep(5);
-	for (i = 0; i < THREADNUM ; i++){
-		if( pthread_create(&worker[i], NULL, (void *) &worker_routine, NULL) != 0){
-			perror("Error creating the worker thread\n");
+	/* create listener threads */
+	for (i = 0; i < listener_count; i++){
+		if( pthread_create(&listeners[i].thread, NULL, (void *) &listener_routine, (void *) &listeners[i]) != 0){
+			perror("Error creating the listener thread\n");
+		}
+	}
+
+	/* -t lets the waiting queue fill before anything is scheduled. A restarted process has connections
+	 * waiting on it already and an archive is served at full speed from the start : both skip the delays */
+	queuing_delay = (SLEEP_TIME > 0 && archive_file_name == NULL && !(shared_child != NULL && shared_child -> restarts > 0));
+	if (queuing_delay)
+		sleep(SLEEP_TIME);
+
+	/* create a scheduler thread per listener : with work stealing the listeners dispatch to the workers themselves */
+	for (i = 0; work_stealing == 0 && i < listener_count; i++){
+		if( pthread_create(&listeners[i].scheduler, NULL, (void *) &scheduler_routine, (void *) &listeners[i]) != 0){
+			perror("Error creating the scheduler thread\n");
 		}
 	}
+
+	/* create worker threads, a few seconds after the schedulers when the queue is being held */
+	if (queuing_delay)
+		sleep(5);
+	for (i = 0; i < THREADNUM ; i++){
+		start_worker(i);
+	}
+
+	/* create the pool manager when the pool may grow */
+	if (worker_max > THREADNUM && pthread_create(&pool_manager, NULL, (void *) &pool_manager_routine, NULL) != 0){
+		perror("Error creating the pool manager thread\n");
+	}
 	
-	/* Join listener and scheduler with the main thread */
-	pthread_join(listener, NULL);
-	pthread_join(scheduler, NULL);
+	/* Join listeners and schedulers with the main thread */
+	for (i = 0; i < listener_count; i++){
+		pthread_join(listeners[i].thread, NULL);
+		if (work_stealing == 0)
+			pthread_join(listeners[i].scheduler, NULL);
+	}
+	if (worker_max > THREADNUM)
+		pthread_join(pool_manager, NULL);
 	for (i = 0; i < THREADNUM; i++){
-		pthread_join(worker[i], NULL);
+		pthread_join(worker_slots[i].thread, NULL);
 	}
+	for (i = 0; i < worker_max; i++)
+		pthread_mutex_destroy(&worker_slots[i].mutex);
 	
-	pthread_mutex_destroy(&waiting_queue_mutex);
-	pthread_mutex_destroy(&ready_queue_mutex);
-	pthread_cond_destroy(&waiting_queue_empty);
+	for (i = 0; i < listener_count; i++){
+		pthread_mutex_destroy(&listeners[i].waiting_queue_mutex);
+		pthread_mutex_destroy(&listeners[i].idle_connections_mutex);
+		pthread_cond_destroy(&listeners[i].waiting_queue_empty);
+	}
+	pthread_mutex_destroy(&log_rings_mutex);
+	pthread_mutex_destroy(&stage_histograms_mutex);
 	pthread_exit(NULL);
 }
+#endif
 
 /* 
  * PARSE THE INPUT FOR MAIN METHOD 
  */
 
-void parse_input(int argc, char *argv)
+void parse_input(int argc, char *argv[])
 {
 	char ch;
 
-	while ((ch = getopt(argc, argv, "dhl:p:r:t:n:s:")) != -1)
+	while ((ch = getopt(argc, argv, "dhfl:p:r:t:n:s:b:k:a:wc:m:F:B:R:T:z:L:PN:A:x:Xuj:q:D:Q:")) != -1)
 	{
 		switch(ch) 
 		{
@@ -188,6 +996,10 @@ void parse_input(int argc, char *argv)
 				debug = 1;
 				printf("In debugging mode\n");
 				break;
+			case 'f':
+				// Stay in the foreground without entering debugging mode
+				foreground = 1;
+				break;
 			case 'h':
 				// Print usage summary with all options and exit
 				help_flag = 1;
@@ -197,6 +1009,22 @@ void parse_input(int argc, char *argv)
 				create_log = 1;
 				strcpy(log_file_name, optarg);
 				break;
+			case 'F':
+				// Set how often the access log is flushed in milliseconds. Default = 1000
+				log_flush_interval = atoll(optarg);
+				break;
+			case 'B':
+				// Set the access log batch size in kilobytes which forces a flush. Default = 64
+				log_flush_size = atoi(optarg) * 1024;
+				break;
+			case 'R':
+				// Rotate the access log once it grows past the given megabytes
+				log_rotate_size = atol(optarg) * 1024 * 1024;
+				break;
+			case 'T':
+				// Rotate the access log every given number of seconds
+				log_rotate_interval = atol(optarg);
+				break;
 			case 'p':
 				port_number = atoi(optarg);
 				break;
@@ -220,9 +1048,106 @@ void parse_input(int argc, char *argv)
 					use_SJF = 1;
 					printf("Scheduling Policy chosen is : SJF\n");
 				}
+				else if( (strcmp(optarg, "EDF") == 0) || (strcmp(optarg, "edf") == 0) ){
+					use_EDF = 1;
+					printf("Scheduling Policy chosen is : EDF\n");
+				}
+				else if( (strcmp(optarg, "DRR") == 0) || (strcmp(optarg, "drr") == 0) ){
+					use_DRR = 1;
+					printf("Scheduling Policy chosen is : DRR\n");
+				}
+				break;
+			case 'b':
+				// Set the backlog of pending connections passed to listen. Default = 1024
+				listen_backlog = atoi(optarg);
+				break;
+			case 'k':
+				// Set the number of seconds an idle keep-alive connection is kept open. Default = 15
+				keep_alive_timeout = atoi(optarg);
+				break;
+			case 'w':
+				// Dispatch requests straight to per worker queues with work stealing instead of the scheduler thread
+				work_stealing = 1;
+				break;
+			case 'c':
+				// Set the size of the in memory file cache in megabytes. Default = 0 (no cache)
+				cache_capacity = atol(optarg) * 1024 * 1024;
+				break;
+			case 'm':
+				// Set how many milliseconds file metadata is cached. Default = 1000, 0 disables the metadata cache
+				metadata_ttl = atoll(optarg);
+				break;
+			case 'N':
+				// Set the largest number of worker threads the pool may grow to. Default = -n, a fixed pool
+				worker_max = atoi(optarg);
+				break;
+			case 'A':
+				// Set the placement of the workers : cpu pins worker i to one CPU, node spreads them over the NUMA nodes
+				if (strcmp(optarg, "cpu") == 0)
+					worker_affinity = AFFINITY_CPU;
+				else if (strcmp(optarg, "node") == 0)
+					worker_affinity = AFFINITY_NODE;
+				else{
+					usage();
+					exit(1);
+				}
+				break;
+			case 'L':
+				// Set the number of listener threads, each with its own SO_REUSEPORT socket. Default = 1
+				listener_count = atoi(optarg);
+				if (listener_count < 1)
+					listener_count = 1;
+				break;
+			case 'Q':
+				// Set the DRR quantum : bytes of credit a client earns per round. Default = 65536
+				drr_quantum = atol(optarg);
+				if (drr_quantum < DRR_REQUEST_COST)
+					drr_quantum = DRR_REQUEST_COST;
+				break;
+			case 'q':
+				// Set how many requests may be admitted and not answered yet, the next ones get 503. Default = 0 (no cap)
+				admission_cap = atol(optarg);
+				break;
+			case 'D':
+				// Set the deadline of a request in milliseconds from its arrival, a request still waiting after it gets 503. Default = 0 (none)
+				request_deadline_ms = atoll(optarg);
+				break;
+			case 'j':
+				// Prefork the given number of worker processes, each with its own listeners, scheduler and workers
+				prefork_count = atoi(optarg);
+				if (prefork_count > MAX_PROCESSES)
+					prefork_count = MAX_PROCESSES;
+				break;
+			case 'P':
+				// Pin listener i to CPU i, or worker process i to CPU i with -j
+				pin_listeners = 1;
+				break;
+			case 'u':
+				// Run the listeners on io_uring instead of epoll, when the kernel allows it
+#ifdef HAVE_IO_URING
+				use_io_uring = 1;
+#else
+				printf("Built without io_uring, the listeners use epoll\n");
+#endif
+				break;
+			case 'x':
+				// Serve the document root from an archive written by myhttpd_pack
+				archive_file_name = optarg;
+				break;
+			case 'X':
+				// Read the whole archive into memory at startup
+				archive_prefetch = 1;
+				break;
+			case 'z':
+				// Set the size of the gzip variant cache in megabytes. Default = 16, 0 only serves precompressed files
+				variant_capacity = atol(optarg) * 1024 * 1024;
+				break;
+			case 'a':
+				// Set the SJF aging rate in bytes per second of waiting. Default = 0 (pure SJF)
+				sjf_aging = atoll(optarg);
 				break;
 			case '?':
-				if (optopt == 'p' || optopt == 'r' || optopt == 't' || optopt == 'n' || optopt == 's')
+				if (optopt == 'p' || optopt == 'r' || optopt == 't' || optopt == 'n' || optopt == 's' || optopt == 'b' || optopt == 'k' || optopt == 'a' || optopt == 'c' || optopt == 'm' || optopt == 'F' || optopt == 'B' || optopt == 'R' || optopt == 'T' || optopt == 'z' || optopt == 'L' || optopt == 'N' || optopt == 'A' || optopt == 'x' || optopt == 'j' || optopt == 'q' || optopt == 'D' || optopt == 'Q')
 					fprintf(stderr, "Option - %c need an arguement\n", optopt);
 				else
 					fprintf(stderr, "Unknown option - %c", optopt);
@@ -231,484 +1156,4001 @@ void parse_input(int argc, char *argv)
 				usage();
 		}
 	}
-	if (debug == 0)
+	if (debug == 0 && foreground == 0)
 		daemon(1, 0);
-	if (use_SJF == 0)
+	if (use_SJF == 0 && use_EDF == 0 && use_DRR == 0)
 		printf("Scheduling Policy chosen is : FCFS\n\n");
+	if (use_DRR && work_stealing){
+		/* the per client sub-queues live in front of the scheduler thread, which -w takes away */
+		printf("Fair queuing needs the scheduler threads, -w is ignored\n");
+		work_stealing = 0;
+	}
 }
 
 /*
  * LISTENER ROUTINE BEGINS
  */
-void listener_routine(void *sock_server){
-	/* create a listener which continuously listens for the incoming requests */
-	int sockfd = *((int *)sock_server), return_value, acceptfd;
-	struct sockaddr_in client;
-	socklen_t client_len;
-	char buffer[512];
-	pthread_t worker[10];
-	char client_ip[20];
-		
-	/* listen for incoming requests */ 
-	listen(sockfd, 5);
+void listener_routine(void *listener_argument){
+	/* create a listener which multiplexes the listening socket and every half received request over one epoll instance */
+	Listener *listener = (Listener *)listener_argument;
+	int sockfd = listener -> sockfd, epollfd, ready, i, return_value;
+	struct epoll_event event, events[MAX_EPOLL_EVENTS];
+	Connection *connection;
+
+	/* -P : listener i runs on CPU i, next to the receive queue the kernel steers its connections to, with -j the whole process is pinned instead */
+	if (pin_listeners && prefork_count == 0)
+		pin_to_cpu(listener -> id);
+
+#ifdef HAVE_IO_URING
+	if (use_io_uring){
+		if (uring_listener_init(listener) == 0)
+			uring_listener_loop(listener);
+		printf("io_uring is not available, listener %d falls back to epoll\n", listener -> id);
+	}
+#endif
+
+	epollfd = epoll_create1(0);
+	listener -> epollfd = epollfd;
+	if (epollfd < 0){
+		perror("Error occurred in listener:epoll_create1 function\n");
+		exit(1);
+	}
+	event.events = EPOLLIN | EPOLLET;
+	event.data.ptr = NULL;	/* NULL marks the listening socket */
+	epoll_ctl(epollfd, EPOLL_CTL_ADD, sockfd, &event);
 
 	/* keep listening */
 	while(1)
 	{	
-		/* accept the incoming connection */
-		acceptfd = accept(sockfd, (struct sockaddr *) &client, &client_len);
-		
-		/* get the client IP */
-		strcpy(client_ip, (char *)inet_ntoa(client.sin_addr)); 
+		/* wake up at least once a second to close the idle keep-alive connections, sooner when an accept was put off */
+		ready = epoll_wait(epollfd, events, MAX_EPOLL_EVENTS, listener -> accept_deferred ? ACCEPT_DEFER_MS : 1000);
+		if (ready < 0){
+			if (errno != EINTR)
+				perror("Error occurred in listener:epoll_wait function\n");
+			continue;
+		}
 
-		if (acceptfd == -1){
-			perror("Error in accepting the client\n");
+		/* every process saw the edge : the deferred connections are gone unless no other process took them */
+		if (listener -> accept_deferred && !accept_is_deferred()){
+			listener -> accept_deferred = 0;
+			accept_connections(listener);
 		}
-		
-		if (acceptfd > 0){
-			/* recieve the request */
-			return_value = recv(acceptfd, &buffer, sizeof(buffer), 0);
 
-			if(return_value < 0)
-				perror("Error occurred in listener:recv function\n");
-			
-			if(return_value == 0)
-				printf("Ending Connection !\n");
-			
-			if(return_value > 0){
-				/* parse the incoming request */
-				pthread_mutex_lock(&waiting_queue_mutex);
-				printf("Listener acquired the lock\n");
-				parse_request(buffer, acceptfd, client_ip);
-				pthread_mutex_unlock(&waiting_queue_mutex);
-				printf("Listener released the lock\n");
+		for (i = 0; i < ready; i++){
+			connection = (Connection *)events[i].data.ptr;
+			if (connection == NULL){
+				if (accept_is_deferred())
+					listener -> accept_deferred = 1;
+				else
+					accept_connections(listener);
+				continue;
 			}
-		}
-	}
-}
 
-void parse_request(char request[], int acceptfd, char client_ip[]){
-	int i = 0, j = 0, signal = 0;
-	char file_name[20], request_type[5], file_path[200], content_type[15], current_dir[200];
-	long int file_size = 0;
-	FILE *fp;
-	Node *new_node;
+			return_value = read_request_head(connection);
+			if (return_value == 0){
+				/* the event is one shot : ask for the rest of the head */
+				rearm_connection(connection);
+				continue;
+			}
 
-	/* TODO Write a separate method to get request type and request path : present code looks CRAPPY :P yaaakksss ! */
-	/* Get the request type and the file path */
-	get_request_type(request, request_type);
-	get_file_name(request, file_name);
-	if (strcmp(file_name, "favicon.ico") != 0){
-		get_content_type(content_type, file_name);
-		get_file_path(file_path, file_name, current_dir);
-		if(strcmp(request_type, "HEAD") == 0)
-			file_size = 0;
-		else
-			file_size = get_file_size(file_path);
-		new_node = (Node *)malloc(sizeof(Node));
-		/* Take the lock on waiting queue and Create and insert node in the waiting queue */
-		new_node = create_queue_node(acceptfd, request_type, file_name, client_ip, file_size, file_path, content_type, current_dir);
-		get_current_time(new_node -> arrival_time);
-		signal = insert_into_queue(&waiting_queue, new_node);
-		if(signal){
-			printf("Signaling the scheduler\n");
-			printf("Listener(): released the lock\n");
-			pthread_cond_signal(&waiting_queue_empty);
-		}	
-		display_queue(&waiting_queue, "Waiting Queue");
+			remove_idle_connection(connection);
+			if (return_value < 0){
+				close_connection(connection);
+			}
+			else{
+				/* the full request head has arrived : hand the connection over to the queues */
+				connection -> state = CONNECTION_QUEUED;
+				return_value = parse_request(connection);
+				if (return_value == 0)
+					close_connection(connection);
+			}
+		}
+		close_idle_connections(listener);
 	}
 }
 
-long int get_file_size(char file_path[]){
-	FILE *fp;
-	int file_size;
+#ifdef HAVE_IO_URING
+/*
+ * IO_URING : SET UP A RING AND MAP ITS SUBMISSION AND COMPLETION QUEUES, RETURNS -1 WHEN THE KERNEL REFUSES
+ */
+int uring_init(Uring *ring, unsigned entries){
+	struct io_uring_params params;
+	size_t sq_size, cq_size;
+	char *sq, *cq;
 
-	fp = fopen(file_path, "r+");
-	if (fp == NULL){
-		perror("Error in file opening");
-		return 0;
+	memset(ring, 0, sizeof(Uring));
+	memset(&params, 0, sizeof(params));
+	ring -> fd = syscall(__NR_io_uring_setup, entries, &params);
+	if (ring -> fd < 0)
+		return -1;
+	/* accept multishot and the other operations used here need a recent kernel : the single mmap comes with them */
+	if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_NODROP)){
+		close(ring -> fd);
+		return -1;
 	}
-	else{
-		fseek(fp, 0L, SEEK_END);
-		file_size = ftell(fp);	
-		fseek(fp, 0L, SEEK_SET);
-		fclose(fp);
-		return file_size;
+	sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	if (cq_size > sq_size)
+		sq_size = cq_size;
+	sq = (char *)mmap(NULL, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring -> fd, IORING_OFF_SQ_RING);
+	ring -> sqes = (struct io_uring_sqe *)mmap(NULL, params.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring -> fd, IORING_OFF_SQES);
+	ring -> sq_ring = (sq == MAP_FAILED) ? NULL : sq;
+	ring -> sq_ring_size = sq_size;
+	if (ring -> sqes == MAP_FAILED)
+		ring -> sqes = NULL;
+	ring -> sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+	if (ring -> sq_ring == NULL || ring -> sqes == NULL){
+		uring_release(ring);
+		return -1;
 	}
+	cq = sq;
+	ring -> sq_head = (unsigned *)(sq + params.sq_off.head);
+	ring -> sq_tail = (unsigned *)(sq + params.sq_off.tail);
+	ring -> sq_mask = *(unsigned *)(sq + params.sq_off.ring_mask);
+	ring -> sq_array = (unsigned *)(sq + params.sq_off.array);
+	ring -> sq_entries = params.sq_entries;
+	ring -> cq_head = (unsigned *)(cq + params.cq_off.head);
+	ring -> cq_tail = (unsigned *)(cq + params.cq_off.tail);
+	ring -> cq_mask = *(unsigned *)(cq + params.cq_off.ring_mask);
+	ring -> cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+	return 0;
 }
 
-void get_file_path(char file_path[], char file_name[], char current_dir[]){
-	memset(file_path, 0, sizeof(file_path));
-	memset(dir_root, 0, sizeof(dir_root));
-	memset(current_dir, 0, sizeof(current_dir));
-	
-	/* Overwrite everything if tilde is present */
-	if (tilde_present){
-		memset(tilde_root, 0, sizeof(tilde_root));
-		strcat(tilde_root, "/home/");
-		strcat(tilde_root, tilde_user);
-		strcat(tilde_root, "/myhttpd/");
-		strcpy(current_dir, tilde_root);
-		strcat(tilde_root, file_name);
-		strcpy(file_path, tilde_root);
-		tilde_present = 0;
-	}
-	/* see for -r option */
-	else if (custom_root_dir){
-		strcat(dir_root, custom_dir);
-		custom_dir[strlen(custom_dir) - 1];
-		if ( custom_dir[strlen(custom_dir) - 1] != '/')	
-			strcat(dir_root, "/");
-		strcpy(current_dir, dir_root);
-		strcat(dir_root, file_name);
-		strcpy(file_path, dir_root);
-	}
-	/* use the file name as the file path*/
-	else{
-		strcpy(current_dir, "./");
-		strcat(dir_root, file_name);
-		strcpy(file_path, dir_root);
-	}
-	printf("New File path : %s\n\n", file_path);
+/* unmap and close a ring which will not be used */
+void uring_release(Uring *ring){
+	if (ring -> sq_ring != NULL)
+		munmap(ring -> sq_ring, ring -> sq_ring_size);
+	if (ring -> sqes != NULL)
+		munmap(ring -> sqes, ring -> sqes_size);
+	close(ring -> fd);
 }
 
-void get_content_type(char content_type[], char file_name[]){
-	int i = 0;
-	char *file_extention;
+/*
+ * IO_URING : CHECK THAT THE KERNEL TAKES A MULTISHOT ACCEPT (5.19 AND LATER), RETURNS 0 IF IT DOES
+ * The features tested by uring_init come with 5.5 : an older kernel fails every accept with
+ * EINVAL. The probe accepts on a throwaway loopback socket and cancels right away, so a
+ * supported accept ends with ECANCELED and an unsupported one with EINVAL.
+ */
+int uring_probe_accept_multishot(Uring *ring){
+	struct sockaddr_in address;
+	struct io_uring_sqe *sqe;
+	struct io_uring_cqe *cqe;
+	unsigned head;
+	int probe_fd, result = -EINVAL, done = 0;
 
-	while(file_name[i] != '.'){ i++; }
-	i++;
-	file_extention = &file_name[i];
-	if ( (strcmp(file_extention, "txt") == 0) || (strcmp(file_extention, "html") == 0) ){
-		strcpy(content_type, "text/html");
-	}
-	
-	if ( (strcmp(file_extention, "gif") == 0) || (strcmp(file_extention, "jpg") == 0) || (strcmp(file_extention, "jpeg") == 0) ){
-		strcpy(content_type, "image/");
-		strcat(content_type, file_extention);
+	probe_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (probe_fd < 0)
+		return -1;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(probe_fd, (struct sockaddr *) &address, sizeof(address)) < 0 || listen(probe_fd, 1) < 0){
+		close(probe_fd);
+		return -1;
 	}
-}
 
-void get_file_name(char request[], char file_name[]){
-	int i = 0, j = 0;
+	sqe = uring_get_sqe(ring);
+	sqe -> opcode = IORING_OP_ACCEPT;
+	sqe -> fd = probe_fd;
+	sqe -> ioprio = IORING_ACCEPT_MULTISHOT;
+	sqe -> user_data = URING_PROBE;
+	sqe = uring_get_sqe(ring);
+	sqe -> opcode = IORING_OP_ASYNC_CANCEL;
+	sqe -> addr = URING_PROBE;
+	sqe -> user_data = URING_PROBE + 1;
+
+	/* until the accept completes for good : it either failed or was cancelled */
+	while (!done){
+		if (uring_enter(ring, 1) < 0 && errno != EINTR){
+			result = -errno;
+			break;
+		}
+		head = *ring -> cq_head;
+		while (head != __atomic_load_n(ring -> cq_tail, __ATOMIC_ACQUIRE)){
+			cqe = &ring -> cqes[head & ring -> cq_mask];
+			if (cqe -> user_data == URING_PROBE && !(cqe -> flags & IORING_CQE_F_MORE)){
+				result = cqe -> res;
+				done = 1;
+			}
+			head++;
+		}
+		__atomic_store_n(ring -> cq_head, head, __ATOMIC_RELEASE);
+	}
+	close(probe_fd);
+	return (result == -EINVAL || result == -EOPNOTSUPP) ? -1 : 0;
+}
+
+/*
+ * IO_URING : NEXT FREE SUBMISSION ENTRY, ZEROED. A FULL QUEUE IS HANDED TO THE KERNEL FIRST
+ */
+struct io_uring_sqe *uring_get_sqe(Uring *ring){
+	struct io_uring_sqe *sqe;
+	unsigned tail = *ring -> sq_tail;
+
+	while (tail - __atomic_load_n(ring -> sq_head, __ATOMIC_ACQUIRE) >= ring -> sq_entries)
+		uring_enter(ring, 0);
+	sqe = &ring -> sqes[tail & ring -> sq_mask];
+	memset(sqe, 0, sizeof(*sqe));
+	ring -> sq_array[tail & ring -> sq_mask] = tail & ring -> sq_mask;
+	__atomic_store_n(ring -> sq_tail, tail + 1, __ATOMIC_RELEASE);
+	ring -> pending++;
+	return sqe;
+}
+
+/*
+ * IO_URING : SUBMIT EVERYTHING QUEUED AND WAIT FOR AT LEAST wait_count COMPLETIONS, IN ONE SYSCALL
+ */
+int uring_enter(Uring *ring, unsigned wait_count){
+	int submitted;
+
+	submitted = syscall(__NR_io_uring_enter, ring -> fd, ring -> pending, wait_count, wait_count ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+	if (submitted > 0)
+		ring -> pending -= ((unsigned)submitted < ring -> pending) ? (unsigned)submitted : ring -> pending;
+	return submitted;
+}
+
+/* receive into the rest of the connection's head buffer, the parser reads it in place */
+void uring_submit_recv(Listener *listener, Connection *connection){
+	struct io_uring_sqe *sqe = uring_get_sqe(listener -> ring);
+
+	sqe -> opcode = IORING_OP_RECV;
+	sqe -> fd = connection -> fd;
+	sqe -> addr = (unsigned long)(connection -> buffer + connection -> length);
+	sqe -> len = REQUEST_HEAD_SIZE - connection -> length;
+	sqe -> user_data = (unsigned long)connection;
+}
+
+void uring_submit_accept(Listener *listener){
+	struct io_uring_sqe *sqe = uring_get_sqe(listener -> ring);
+
+	/* multishot : one submission keeps accepting until the kernel drops it */
+	sqe -> opcode = IORING_OP_ACCEPT;
+	sqe -> fd = listener -> sockfd;
+	sqe -> ioprio = IORING_ACCEPT_MULTISHOT;
+	sqe -> accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+	sqe -> user_data = URING_ACCEPT;
+}
+
+void uring_submit_wakeup_read(Listener *listener){
+	struct io_uring_sqe *sqe = uring_get_sqe(listener -> ring);
+
+	sqe -> opcode = IORING_OP_READ;
+	sqe -> fd = listener -> wakeup_fd;
+	sqe -> addr = (unsigned long)&listener -> wakeup_count;
+	sqe -> len = sizeof(listener -> wakeup_count);
+	sqe -> user_data = URING_WAKEUP;
+}
+
+void uring_submit_timeout(Listener *listener){
+	static struct __kernel_timespec one_second = { 1, 0 };
+	struct io_uring_sqe *sqe = uring_get_sqe(listener -> ring);
+
+	/* the idle sweep runs once a second, as with the epoll_wait timeout */
+	sqe -> opcode = IORING_OP_TIMEOUT;
+	sqe -> addr = (unsigned long)&one_second;
+	sqe -> len = 1;
+	sqe -> user_data = URING_TIMEOUT;
+}
+
+/*
+ * IO_URING LISTENER : SET UP THE RING, THE WAKE UP EVENTFD AND THE FIRST SUBMISSIONS
+ */
+int uring_listener_init(Listener *listener){
+	listener -> ring = (Uring *)calloc(1, sizeof(Uring));
+	if (uring_init(listener -> ring, URING_ENTRIES) < 0){
+		free(listener -> ring);
+		listener -> ring = NULL;
+		return -1;
+	}
+	if (uring_probe_accept_multishot(listener -> ring) < 0){
+		printf("The kernel has no multishot accept for io_uring\n");
+		uring_release(listener -> ring);
+		free(listener -> ring);
+		listener -> ring = NULL;
+		return -1;
+	}
+	listener -> wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (listener -> wakeup_fd < 0){
+		perror("Error occurred in listener:eventfd function\n");
+		uring_release(listener -> ring);
+		free(listener -> ring);
+		listener -> ring = NULL;
+		return -1;
+	}
+	uring_submit_accept(listener);
+	uring_submit_wakeup_read(listener);
+	uring_submit_timeout(listener);
+	return 0;
+}
+
+/*
+ * IO_URING LISTENER ROUTINE : ONE io_uring_enter SUBMITS EVERY RECV OF THE LAST ROUND AND REAPS A BATCH OF COMPLETIONS
+ * Completions carry the connection as user data. Connections given back by the workers
+ * arrive on the rearm stack, announced through the eventfd, and get their next recv here,
+ * since only this thread submits to the ring.
+ */
+void uring_listener_loop(Listener *listener){
+	Uring *ring = listener -> ring;
+	struct io_uring_cqe *cqe;
+	struct sockaddr_in client;
+	socklen_t client_len;
+	Connection *connection, *rearmed;
+	unsigned head;
+	unsigned long user_data;
+	int result, return_value;
+
+	printf("Listener %d uses io_uring\n", listener -> id);
+	while(1){
+		if (uring_enter(ring, 1) < 0 && errno != EINTR && errno != EBUSY)
+			perror("Error occurred in listener:io_uring_enter function\n");
+
+		head = *ring -> cq_head;
+		while (head != __atomic_load_n(ring -> cq_tail, __ATOMIC_ACQUIRE)){
+			cqe = &ring -> cqes[head & ring -> cq_mask];
+			user_data = cqe -> user_data;
+			result = cqe -> res;
+			head++;
+
+			if (user_data == URING_ACCEPT){
+				if (result >= 0){
+					client_len = sizeof(client);
+					if (getpeername(result, (struct sockaddr *) &client, &client_len) < 0)
+						memset(&client, 0, sizeof(client));
+					connection = setup_connection(listener, result, &client);
+					uring_submit_recv(listener, connection);
+				}
+				else if (result != -EAGAIN && result != -EINTR)
+					printf("Error in accepting the client : %s\n", strerror(-result));
+				if (!(cqe -> flags & IORING_CQE_F_MORE))
+					uring_submit_accept(listener);
+				continue;
+			}
+			if (user_data == URING_WAKEUP){
+				/* connections handed back by the workers */
+				rearmed = __atomic_exchange_n(&listener -> rearm_stack, NULL, __ATOMIC_ACQUIRE);
+				while (rearmed != NULL){
+					connection = rearmed;
+					rearmed = rearmed -> rearm_next;
+					uring_submit_recv(listener, connection);
+				}
+				uring_submit_wakeup_read(listener);
+				continue;
+			}
+			if (user_data == URING_TIMEOUT){
+				close_idle_connections(listener);
+				uring_submit_timeout(listener);
+				continue;
+			}
+
+			connection = (Connection *)user_data;
+			if (connection -> state == CONNECTION_CLOSING){
+				/* timed out : shut down by the idle sweep, already off the idle list */
+				close_connection(connection);
+				continue;
+			}
+			if (result == -EINTR || result == -EAGAIN){
+				uring_submit_recv(listener, connection);
+				continue;
+			}
+			if (result <= 0){
+				if (result < 0)
+					printf("Error occurred in listener:recv : %s\n", strerror(-result));
+				else
+					printf("Ending Connection !\n");
+				remove_idle_connection(connection);
+				close_connection(connection);
+				continue;
+			}
+
+			return_value = request_head_received(connection, result);
+			if (return_value == 0 && connection -> length == REQUEST_HEAD_SIZE){
+				printf("Request head too large, dropping the client\n");
+				reject_request(connection, RESPONSE_HEADERS_TOO_LARGE);
+				return_value = -1;
+			}
+			if (return_value == 0){
+				uring_submit_recv(listener, connection);
+				continue;
+			}
+			remove_idle_connection(connection);
+			if (return_value < 0){
+				close_connection(connection);
+			}
+			else{
+				/* the full request head has arrived : hand the connection over to the queues */
+				connection -> state = CONNECTION_QUEUED;
+				return_value = parse_request(connection);
+				if (return_value == 0)
+					close_connection(connection);
+			}
+		}
+		__atomic_store_n(ring -> cq_head, head, __ATOMIC_RELEASE);
+	}
+}
+#endif
+
+/*
+ * CREATE AND BIND A LISTENING SOCKET, WITH SO_REUSEPORT WHEN SEVERAL LISTENERS SHARE THE PORT
+ */
+int create_listening_socket(int reuse_port){
+	struct sockaddr_in server;
+	int sock_server, one = 1;
+
+	server.sin_family = AF_INET;
+	server.sin_addr.s_addr	= INADDR_ANY;
+	server.sin_port = htons(port_number);
+
+	/* create socket on local host */
+	sock_server = socket(AF_INET, SOCK_STREAM, 0);
+	if (sock_server < 0){
+		perror("Error creating socket for server\n");
+		exit(1);
+	}
+	if (reuse_port && setsockopt(sock_server, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) < 0){
+		perror("SO_REUSEPORT failed.\n");
+		exit(1);
+	}
+
+	/* call bind */
+	if ( bind(sock_server, (struct sockaddr *) &server, sizeof(server)) < 0 ){
+		perror("Bind for server failed.\n");
+		exit(1);
+	}
+
+	/* listen here rather than in the listener, so that the socket outlives the processes of -j */
+	if (listen(sock_server, listen_backlog) < 0){
+		perror("Error occurred in listener:listen function\n");
+		exit(1);
+	}
+
+	/* the listening socket is non blocking so that accept can be drained after an edge */
+	fcntl(sock_server, F_SETFL, fcntl(sock_server, F_GETFL, 0) | O_NONBLOCK);
+	return sock_server;
+}
+
+/* run the calling thread on one CPU only, wrapping around when there are fewer CPUs than threads */
+void pin_to_cpu(int cpu){
+	cpu_set_t cpus;
+	long online = sysconf(_SC_NPROCESSORS_ONLN);
+
+	CPU_ZERO(&cpus);
+	CPU_SET(cpu % ((online > 0) ? online : 1), &cpus);
+	if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0)
+		printf("Could not pin the thread to CPU %d\n", cpu);
+}
+
+/*
+ * PREFORK : FORK THE -j WORKER PROCESSES AND KEEP THEM RUNNING, ONLY RETURNS IN A CHILD
+ * The listening sockets stay open in the master, so a child which dies loses its own
+ * connections only : the port keeps accepting while the replacement starts.
+ */
+void prefork_master(){
+	int i, status;
+	pid_t pid;
+	SharedChild *child;
+
+	shared_stats = (SharedStats *)mmap(NULL, sizeof(SharedStats), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (shared_stats == MAP_FAILED){
+		perror("Error mapping the shared statistics\n");
+		exit(1);
+	}
+	shared_stats -> process_count = prefork_count;
+	for (i = 0; i < prefork_count; i++){
+		if (spawn_child(i) == 0)
+			return;
+	}
+
+	while (1){
+		pid = waitpid(-1, &status, 0);
+		if (pid < 0){
+			if (errno != EINTR)
+				perror("Error occurred in master:waitpid function\n");
+			continue;
+		}
+		for (i = 0; i < prefork_count && shared_stats -> children[i].pid != pid; i++);
+		if (i == prefork_count)
+			continue;
+
+		child = &shared_stats -> children[i];
+		printf("Process %d (pid %d) exited with status %d, restarting it\n", i, (int)pid, status);
+		__atomic_add_fetch(&child -> restarts, 1, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&shared_stats -> restarts, 1, __ATOMIC_RELAXED);
+		/* its queue went down with it */
+		__atomic_store_n(&child -> queue_depth, 0, __ATOMIC_RELAXED);
+
+		/* a child which dies right away would otherwise be forked in a tight loop */
+		if (get_monotonic_ns() - child -> started_ns < 1000000000LL)
+			sleep(1);
+		if (spawn_child(i) == 0)
+			return;
+	}
+}
+
+/* fork process index : returns 0 in the child and the pid in the master */
+int spawn_child(int index){
+	pid_t pid, master = getpid();
+
+	shared_stats -> children[index].started_ns = get_monotonic_ns();
+	pid = fork();
+	if (pid < 0){
+		perror("Error occurred in master:fork function\n");
+		return -1;
+	}
+	if (pid > 0){
+		shared_stats -> children[index].pid = pid;
+		return pid;
+	}
+
+	/* the child leaves with the master, even when the master is killed */
+	prctl(PR_SET_PDEATHSIG, SIGTERM);
+	if (getppid() != master)
+		exit(1);
+	process_index = index;
+	shared_child = &shared_stats -> children[index];
+	shared_child -> pid = getpid();
+	if (pin_listeners)
+		pin_to_cpu(index);
+	return 0;
+}
+
+/* load aware accept : a process holding ACCEPT_SLACK more requests than the least loaded one lets it accept */
+int accept_is_deferred(){
+	long depth, least = LONG_MAX;
+	int i;
+
+	if (shared_child == NULL)
+		return 0;
+	depth = __atomic_load_n(&shared_child -> queue_depth, __ATOMIC_RELAXED);
+	for (i = 0; i < shared_stats -> process_count; i++){
+		if (&shared_stats -> children[i] != shared_child && __atomic_load_n(&shared_stats -> children[i].queue_depth, __ATOMIC_RELAXED) < least)
+			least = __atomic_load_n(&shared_stats -> children[i].queue_depth, __ATOMIC_RELAXED);
+	}
+	return least != LONG_MAX && depth > least + ACCEPT_SLACK;
+}
+
+/*
+ * ACCEPT EVERY PENDING CONNECTION AND REGISTER IT WITH EPOLL
+ */
+void accept_connections(Listener *listener){
+	int sockfd = listener -> sockfd, epollfd = listener -> epollfd, acceptfd;
+	struct sockaddr_in client;
+	socklen_t client_len;
+	struct epoll_event event;
+	Connection *connection;
+
+	while(1){
+		client_len = sizeof(client);
+		acceptfd = accept4(sockfd, (struct sockaddr *) &client, &client_len, SOCK_NONBLOCK);
+		if (acceptfd < 0){
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				perror("Error in accepting the client\n");
+			return;
+		}
+
+		connection = setup_connection(listener, acceptfd, &client);
+		event.events = EPOLLIN | EPOLLET | EPOLLRDHUP | EPOLLONESHOT;
+		event.data.ptr = connection;
+		if (epoll_ctl(epollfd, EPOLL_CTL_ADD, acceptfd, &event) < 0){
+			perror("Error occurred in listener:epoll_ctl function\n");
+			remove_idle_connection(connection);
+			close_connection(connection);
+		}
+	}
+}
+
+/*
+ * A NEW CONNECTION IN THE READ PATH OF THE LISTENER
+ */
+Connection *setup_connection(Listener *listener, int acceptfd, struct sockaddr_in *client){
+	Connection *connection;
+	int one = 1;
+
+	/* responses leave in one sendmsg, or are corked with MSG_MORE ahead of sendfile : Nagle would only add delay */
+	setsockopt(acceptfd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+	connection = (Connection *)pool_alloc(&connection_pool, &connection_pool_cache);
+	connection -> listener = listener;
+	connection -> fd = acceptfd;
+	connection -> length = 0;
+	connection -> head_length = 0;
+	http_request_reset(&connection -> request);
+	connection -> request_start_ns = get_monotonic_ns();
+	connection -> buffer[0] = '\0';
+	/* get the client IP */
+	strcpy(connection -> client_ip, (char *)inet_ntoa(client -> sin_addr)); 
+	add_idle_connection(connection);
+	return connection;
+}
+
+/*
+ * READ WHATEVER HAS ARRIVED ON THE CONNECTION
+ * returns 1 once the request head is complete, 0 if more data is needed and -1 if the connection has to be closed
+ */
+int read_request_head(Connection *connection){
+	int return_value;
+
+	while(1){
+		if (connection -> length == REQUEST_HEAD_SIZE){
+			printf("Request head too large, dropping the client\n");
+			reject_request(connection, RESPONSE_HEADERS_TOO_LARGE);
+			return -1;
+		}
+
+		/* recieve the request */
+		return_value = recv(connection -> fd, connection -> buffer + connection -> length, REQUEST_HEAD_SIZE - connection -> length, 0);
+		if (return_value < 0){
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return 0;
+			perror("Error occurred in listener:recv function\n");
+			return -1;
+		}
+		if (return_value == 0){
+			printf("Ending Connection !\n");
+			return -1;
+		}
+
+		return_value = request_head_received(connection, return_value);
+		if (return_value != 0)
+			return return_value;
+	}
+}
+
+/*
+ * received BYTES HAVE BEEN ADDED TO THE HEAD BUFFER : RESUME THE PARSER, SAME RESULTS AS read_request_head
+ */
+int request_head_received(Connection *connection, int received){
+	int return_value;
+
+	/* the first bytes of a new request on a kept alive connection start its clock */
+	if (connection -> request_start_ns == 0)
+		connection -> request_start_ns = get_monotonic_ns();
+	connection -> length += received;
+	connection -> buffer[connection -> length] = '\0';
+	return_value = parse_http_request(&connection -> request, connection -> buffer, connection -> length);
+	if (return_value == PARSE_ERROR){
+		reject_request(connection, connection -> request.error);
+		return -1;
+	}
+	if (return_value == PARSE_COMPLETE){
+		connection -> head_length = connection -> request.head_length;
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * HTTP REQUEST PARSER : RESUMABLE, PICKS UP WHERE THE LAST recv LEFT OFF
+ * Every byte of the head is looked at once : complete lines are split into zero copy slices
+ * of the receive buffer and the unfinished line is searched again only from its unread part.
+ * Returns PARSE_COMPLETE with head_length set, PARSE_INCOMPLETE or PARSE_ERROR with error set.
+ */
+int parse_http_request(HttpRequest *request, char *buffer, int length){
+	int newline, line_end;
+
+	while (request -> scanned < length){
+		newline = find_byte(buffer + request -> scanned, length - request -> scanned, '\n');
+		if (newline < 0){
+			request -> scanned = length;
+			break;
+		}
+		newline += request -> scanned;
+		request -> scanned = newline + 1;
+		line_end = (newline > request -> line_start && buffer[newline - 1] == '\r') ? newline - 1 : newline;
+
+		if (!request -> request_line_done){
+			/* empty lines ahead of the request line are allowed */
+			if (line_end > request -> line_start){
+				if (parse_request_line(request, buffer + request -> line_start, line_end - request -> line_start) < 0)
+					return PARSE_ERROR;
+				request -> request_line_done = 1;
+			}
+		}
+		else if (line_end == request -> line_start){
+			/* the blank line : the head is complete */
+			request -> head_length = newline + 1;
+			return PARSE_COMPLETE;
+		}
+		else if (parse_header_line(request, buffer + request -> line_start, line_end - request -> line_start) < 0){
+			return PARSE_ERROR;
+		}
+		request -> line_start = newline + 1;
+	}
+
+	if (!request -> request_line_done && length - request -> line_start > MAX_PATH_LENGTH + 64){
+		request -> error = RESPONSE_URI_TOO_LONG;
+		return PARSE_ERROR;
+	}
+	return PARSE_INCOMPLETE;
+}
+
+/*
+ * METHOD SP PATH SP HTTP/x.y
+ */
+int parse_request_line(HttpRequest *request, char *line, int length){
+	char *space, *end = line + length, *question_mark;
+	int i;
+
+	request -> error = RESPONSE_BAD_REQUEST;
+	space = memchr(line, ' ', length);
+	if (space == NULL || space == line || space - line > MAX_METHOD_LENGTH)
+		return -1;
+	for (i = 0; line + i < space; i++){
+		if (line[i] < 'A' || line[i] > 'Z')
+			return -1;
+	}
+	request -> method.start = line;
+	request -> method.length = space - line;
+
+	line = space + 1;
+	space = memchr(line, ' ', end - line);
+	if (space == NULL || *line != '/')
+		return -1;
+	if (space - line > MAX_PATH_LENGTH){
+		request -> error = RESPONSE_URI_TOO_LONG;
+		return -1;
+	}
+	for (i = 0; line + i < space; i++){
+		if ((unsigned char)line[i] <= ' ' || line[i] == 127)
+			return -1;
+	}
+	/* the query string is kept apart : only the path names a file */
+	question_mark = memchr(line, '?', space - line);
+	request -> path.start = line;
+	request -> path.length = ((question_mark != NULL) ? question_mark : space) - line;
+	request -> query.start = (question_mark != NULL) ? question_mark + 1 : space;
+	request -> query.length = (question_mark != NULL) ? space - question_mark - 1 : 0;
+
+	line = space + 1;
+	if (end - line != 8 || strncmp(line, "HTTP/", 5) != 0 || !isdigit(line[5]) || line[6] != '.' || !isdigit(line[7]))
+		return -1;
+	request -> version.start = line;
+	request -> version.length = 8;
+	return 0;
+}
+
+/*
+ * NAME ":" OWS VALUE OWS
+ */
+int parse_header_line(HttpRequest *request, char *line, int length){
+	char *colon, *value, *end = line + length;
+	int i;
+
+	request -> error = RESPONSE_BAD_REQUEST;
+	/* folded continuation lines are obsolete and refused */
+	if (*line == ' ' || *line == '\t')
+		return -1;
+	/* no whitespace is allowed between the name and the colon */
+	i = find_byte(line, length, ':');
+	if (i <= 0 || line[i - 1] == ' ' || line[i - 1] == '\t')
+		return -1;
+	colon = line + i;
+	if (request -> header_count == MAX_REQUEST_HEADERS){
+		request -> error = RESPONSE_HEADERS_TOO_LARGE;
+		return -1;
+	}
+
+	value = colon + 1;
+	while (value < end && (*value == ' ' || *value == '\t'))
+		value++;
+	while (end > value && (end[-1] == ' ' || end[-1] == '\t'))
+		end--;
+	request -> headers[request -> header_count].name.start = line;
+	request -> headers[request -> header_count].name.length = colon - line;
+	request -> headers[request -> header_count].value.start = value;
+	request -> headers[request -> header_count].value.length = end - value;
+	request -> header_count++;
+	return 0;
+}
+
+/*
+ * OFFSET OF THE FIRST byte IN data, -1 IF THERE IS NONE
+ * 32 (AVX2) or 16 (SSE2) bytes are compared at once, the tail byte by byte
+ */
+static inline int find_byte(char *data, int length, char byte){
+	int i = 0, mask;
+
+#if defined(__AVX2__)
+	__m256i needle_32 = _mm256_set1_epi8(byte);
+
+	for (; i + 32 <= length; i += 32){
+		mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((__m256i *)(data + i)), needle_32));
+		if (mask != 0)
+			return i + __builtin_ctz(mask);
+	}
+#endif
+#if defined(__SSE2__)
+	__m128i needle_16 = _mm_set1_epi8(byte);
+
+	for (; i + 16 <= length; i += 16){
+		mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((__m128i *)(data + i)), needle_16));
+		if (mask != 0)
+			return i + __builtin_ctz(mask);
+	}
+#endif
+	for (; i < length; i++){
+		if (data[i] == byte)
+			return i;
+	}
+	(void) mask;
+	return -1;
+}
+
+void http_request_reset(HttpRequest *request){
+	request -> scanned = 0;
+	request -> line_start = 0;
+	request -> request_line_done = 0;
+	request -> head_length = 0;
+	request -> header_count = 0;
+	request -> error = NULL;
+}
+
+/*
+ * VALUE OF THE GIVEN HEADER AS A SLICE OF THE RECEIVE BUFFER, NULL IF ABSENT
+ */
+Slice *get_header(HttpRequest *request, char header_name[]){
+	int i, name_length = strlen(header_name);
+
+	for (i = 0; i < request -> header_count; i++){
+		if (request -> headers[i].name.length == name_length && strncasecmp(request -> headers[i].name.start, header_name, name_length) == 0)
+			return &request -> headers[i].value;
+	}
+	return NULL;
+}
+
+/* copy a slice into a C string, truncated to size */
+void copy_slice(char destination[], int size, Slice *slice){
+	int length = (slice -> length < size - 1) ? slice -> length : size - 1;
+
+	memcpy(destination, slice -> start, length);
+	destination[length] = '\0';
+}
+
+/*
+ * ANSWER A REQUEST THE PARSER REFUSED, BEST EFFORT : THE CONNECTION IS CLOSED RIGHT AFTER
+ */
+void reject_request(Connection *connection, char *response){
+	if (response == NULL)
+		response = RESPONSE_BAD_REQUEST;
+	printf("Rejecting request : %.40s\n", response);
+	send(connection -> fd, response, strlen(response), MSG_NOSIGNAL | MSG_DONTWAIT);
+}
+
+/*
+ * COPY THE VALUE OF THE GIVEN HEADER INTO value, EMPTY IF ABSENT
+ */
+void get_header_value(HttpRequest *request, char header_name[], char value[], int value_size){
+	Slice *header = get_header(request, header_name);
+
+	value[0] = '\0';
+	if (header != NULL)
+		copy_slice(value, value_size, header);
+}
+
+/*
+ * HTTP/1.1 CONNECTIONS PERSIST UNLESS THE CLIENT SENDS Connection: close, HTTP/1.0 ONLY WITH Connection: keep-alive
+ */
+int get_keep_alive(HttpRequest *request){
+	char connection_header[32];
+	int http_1_1 = get_http_1_1(request);
+
+	get_header_value(request, "Connection", connection_header, sizeof(connection_header));
+	if (strcasecmp(connection_header, "close") == 0)
+		return 0;
+	if (strcasecmp(connection_header, "keep-alive") == 0)
+		return 1;
+	return http_1_1;
+}
+
+int get_http_1_1(HttpRequest *request){
+	return strncmp(request -> version.start, "HTTP/1.1", 8) == 0;
+}
+
+/*
+ * AFTER A RESPONSE : CLOSE THE CONNECTION OR RETURN IT TO THE READ PATH
+ * A pipelined request already in the buffer is queued right away so responses go out in request order
+ */
+void finish_request(Node *node){
+	Connection *connection = node -> connection;
+	int queued, parsed;
+
+	if (!node -> keep_alive){
+		close_connection(connection);
+		return;
+	}
+
+	/* drop the head that has just been served */
+	connection -> length -= connection -> head_length;
+	memmove(connection -> buffer, connection -> buffer + connection -> head_length, connection -> length + 1);
+	http_request_reset(&connection -> request);
+	connection -> head_length = 0;
+	parsed = parse_http_request(&connection -> request, connection -> buffer, connection -> length);
+	if (parsed == PARSE_COMPLETE)
+		connection -> head_length = connection -> request.head_length;
+	else if (parsed == PARSE_ERROR){
+		reject_request(connection, connection -> request.error);
+		close_connection(connection);
+		return;
+	}
+	connection -> last_active = time(NULL);
+	connection -> request_start_ns = (connection -> length > 0) ? get_monotonic_ns() : 0;
+
+	if (connection -> head_length > 0){
+		queued = parse_request(connection);
+		if (queued == 0)
+			close_connection(connection);
+		return;
+	}
+
+	connection -> state = CONNECTION_READING;
+	add_idle_connection(connection);
+	rearm_connection(connection);
+}
+
+/*
+ * RE-ENABLE THE ONE SHOT EPOLL EVENT : IF DATA IS ALREADY WAITING THE LISTENER IS WOKEN RIGHT AWAY
+ */
+void rearm_connection(Connection *connection){
+	struct epoll_event event;
+	Listener *listener = connection -> listener;
+	unsigned long one = 1;
+
+	if (listener -> ring != NULL){
+		/* only the listener submits to its ring : push the connection and wake it when the stack was empty */
+		connection -> rearm_next = __atomic_load_n(&listener -> rearm_stack, __ATOMIC_RELAXED);
+		while (!__atomic_compare_exchange_n(&listener -> rearm_stack, &connection -> rearm_next, connection, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+			;
+		if (connection -> rearm_next == NULL && write(listener -> wakeup_fd, &one, sizeof(one)) < 0)
+			perror("Error in waking up the listener");
+		return;
+	}
+
+	event.events = EPOLLIN | EPOLLET | EPOLLRDHUP | EPOLLONESHOT;
+	event.data.ptr = connection;
+	epoll_ctl(connection -> listener -> epollfd, EPOLL_CTL_MOD, connection -> fd, &event);
+}
+
+/*
+ * IDLE CONNECTION LIST : EVERY CONNECTION IN THE READ PATH, SO THAT SILENT CLIENTS CAN BE TIMED OUT
+ */
+void add_idle_connection(Connection *connection){
+	Listener *listener = connection -> listener;
+
+	pthread_mutex_lock(&listener -> idle_connections_mutex);
+	connection -> state = CONNECTION_READING;
+	connection -> last_active = time(NULL);
+	connection -> previous = NULL;
+	connection -> next = listener -> idle_connections;
+	if (listener -> idle_connections != NULL)
+		listener -> idle_connections -> previous = connection;
+	listener -> idle_connections = connection;
+	pthread_mutex_unlock(&listener -> idle_connections_mutex);
+}
+
+void remove_idle_connection(Connection *connection){
+	Listener *listener = connection -> listener;
+
+	pthread_mutex_lock(&listener -> idle_connections_mutex);
+	if (connection -> previous != NULL)
+		connection -> previous -> next = connection -> next;
+	else
+		listener -> idle_connections = connection -> next;
+	if (connection -> next != NULL)
+		connection -> next -> previous = connection -> previous;
+	connection -> next = NULL;
+	connection -> previous = NULL;
+	pthread_mutex_unlock(&listener -> idle_connections_mutex);
+}
+
+/*
+ * CLOSE THE CONNECTIONS WHICH HAVE BEEN WAITING FOR A REQUEST LONGER THAN keep_alive_timeout
+ */
+void close_idle_connections(Listener *listener){
+	Connection *iterator, *next;
+	time_t now = time(NULL);
+
+	pthread_mutex_lock(&listener -> idle_connections_mutex);
+	iterator = listener -> idle_connections;
+	while (iterator != NULL){
+		next = iterator -> next;
+		if (now - iterator -> last_active >= keep_alive_timeout){
+			if (iterator -> previous != NULL)
+				iterator -> previous -> next = next;
+			else
+				listener -> idle_connections = next;
+			if (next != NULL)
+				next -> previous = iterator -> previous;
+			printf("Closing idle connection : %d\n", iterator -> fd);
+			if (listener -> ring != NULL){
+				/* its recv is still in flight : it fails at once and the completion frees the connection */
+				iterator -> state = CONNECTION_CLOSING;
+				shutdown(iterator -> fd, SHUT_RDWR);
+			}
+			else{
+				close_connection(iterator);
+			}
+		}
+		iterator = next;
+	}
+	pthread_mutex_unlock(&listener -> idle_connections_mutex);
+}
+
+void close_connection(Connection *connection){
+	close(connection -> fd);
+	pool_free(&connection_pool, &connection_pool_cache, connection);
+}
+
+/*
+ * PARSE THE FIRST REQUEST HEAD OF THE CONNECTION AND QUEUE IT, RETURNS 0 IF NOTHING WAS QUEUED
+ */
+int parse_request(Connection *connection){
+	HttpRequest *request = &connection -> request;
+	int i = 0;
+	char file_name[160], request_type[8], file_path[200], content_type[15], current_dir[200];
+	long int file_size = 0;
+	Node *new_node;
+	CacheEntry *cache_entry = NULL;
+	PackEntry *archive_entry = NULL;
+	FileMetadata metadata;
+	Slice *range;
+	int filefd = -1, is_get, accepted_encodings;
+	long admitted;
+	char etag[ETAG_SIZE];
+
+	/* overloaded : refuse before any work on the request, only the metrics page still answers
+	 * The slot is taken right here, so several listeners checking at once cannot all get past the cap */
+	admitted = __atomic_add_fetch(&admitted_requests, 1, __ATOMIC_RELAXED);
+	if (admission_cap > 0 && admitted > admission_cap && !(request -> path.length == 14 && memcmp(request -> path.start, "/server-status", 14) == 0)){
+		__atomic_sub_fetch(&admitted_requests, 1, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&requests_shed_full, 1, __ATOMIC_RELAXED);
+		reject_request(connection, RESPONSE_SERVICE_UNAVAILABLE);
+		return 0;
+	}
+
+	/* Get the request type and the file path from the slices of the parsed head */
+	copy_slice(request_type, sizeof(request_type), &request -> method);
+	get_file_name(&request -> path, file_name);
+	if (strcmp(file_name, "server-status") == 0){
+		/* the metrics page : built by the worker, queued as the shortest possible job */
+		new_node = create_queue_node(connection -> fd, request_type, file_name, connection -> client_ip, 0, "", "text/plain", "./");
+		memset(&new_node -> metadata, 0, sizeof(FileMetadata));
+		new_node -> server_status = 1;
+		new_node -> connection = connection;
+		new_node -> keep_alive = get_keep_alive(request);
+		new_node -> http_1_1 = get_http_1_1(request);
+		new_node -> stage_ns[STAGE_ACCEPTED] = connection -> request_start_ns;
+		new_node -> stage_ns[STAGE_PARSED] = get_monotonic_ns();
+		if (create_log)
+			get_current_time(new_node -> arrival_time);
+		enqueue_request(new_node);
+		return 1;
+	}
+	if (strcmp(file_name, "favicon.ico") != 0){
+		get_content_type(content_type, file_name);
+		/* the archive holds the document root only, not the ~user directories */
+		if (archive_base != NULL && !tilde_present)
+			archive_entry = archive_lookup(file_name);
+		get_file_path(file_path, file_name, current_dir);
+		is_get = (strcmp(request_type, "HEAD") != 0);
+		if (archive_entry != NULL){
+			/* a packed file : everything is in the mapping already */
+			memset(&metadata, 0, offsetof(FileMetadata, header));
+			metadata.exists = 1;
+			metadata.size = archive_entry -> size;
+			metadata.mtime = archive_entry -> mtime;
+			metadata.inode = archive_entry -> inode;
+			metadata.header_length = archive_entry -> header_length;
+			memcpy(metadata.header, archive_entry -> header, archive_entry -> header_length);
+		}
+		else if(is_get && cache_capacity > 0 && (cache_entry = cache_lookup(file_path)) != NULL){
+			/* a hot file : no disk access at all */
+			memset(&metadata, 0, sizeof(metadata));
+			metadata.exists = 1;
+			metadata.size = cache_entry -> size;
+			metadata.mtime = cache_entry -> mtime;
+			metadata.inode = cache_entry -> inode;
+			metadata.header_length = 0;	/* the worker sends the entry's own fragment */
+		}
+		else{
+			filefd = get_file_metadata(file_path, &metadata, is_get);
+		}
+		if(is_get && metadata.exists && !metadata.is_directory)
+			file_size = metadata.size;
+		else
+			file_size = 0;
+		/* Take the lock on waiting queue and Create and insert node in the waiting queue */
+		new_node = create_queue_node(connection -> fd, request_type, file_name, connection -> client_ip, file_size, file_path, content_type, current_dir);
+		new_node -> cache_entry = cache_entry;
+		new_node -> archive_entry = archive_entry;
+		new_node -> metadata = metadata;
+		new_node -> filefd = filefd;
+		new_node -> connection = connection;
+		new_node -> keep_alive = get_keep_alive(request);
+		new_node -> http_1_1 = get_http_1_1(request);
+		range = get_header(request, "Range");
+		if (file_size > 0 && range == NULL && is_compressible(content_type) && (accepted_encodings = get_accepted_encodings(request)) != 0)
+			choose_content_encoding(new_node, accepted_encodings);
+		if (metadata.exists && !metadata.is_directory){
+			/* the tag of the representation chosen above : a gzip variant about to be made included */
+			format_etag(etag, metadata.inode, metadata.size, metadata.mtime, new_node -> compress_pending ? "gzip" : new_node -> content_encoding);
+			if (is_not_modified(request, new_node, etag)){
+				/* 304 : a zero length job, nothing of the file is read */
+				new_node -> not_modified = 1;
+				set_content_encoding(new_node, new_node -> compress_pending ? "gzip" : new_node -> content_encoding, 0);
+				new_node -> compress_pending = 0;
+				if (new_node -> variant != NULL){
+					variant_release(new_node -> variant);
+					new_node -> variant = NULL;
+				}
+			}
+		}
+		if (file_size > 0 && range != NULL && !new_node -> not_modified && if_range_matches(request, &metadata)){
+			new_node -> range_count = parse_byte_ranges(range, metadata.size, new_node -> ranges);
+			if (new_node -> range_count != 0){
+				/* SJF schedules on the bytes which will actually be sent */
+				new_node -> file_size = 0;
+				for (i = 0; i < new_node -> range_count; i++)
+					new_node -> file_size += new_node -> ranges[i].last - new_node -> ranges[i].first + 1;
+			}
+		}
+		new_node -> stage_ns[STAGE_ACCEPTED] = connection -> request_start_ns;
+		new_node -> stage_ns[STAGE_PARSED] = get_monotonic_ns();
+		if (create_log)
+			get_current_time(new_node -> arrival_time);
+		enqueue_request(new_node);
+		return 1;
+	}
+	/* nothing queued : the slot taken above is not used */
+	__atomic_sub_fetch(&admitted_requests, 1, __ATOMIC_RELAXED);
+	return 0;
+}
+
+/*
+ * ONE METADATA LOOKUP PER REQUEST : SIZE, MTIME, EXISTENCE AND TYPE FROM A SINGLE open + fstat
+ * A fresh entry of the metadata cache answers without any syscall but the open needed for the body.
+ * When keep_open is set the open descriptor is returned so the worker can sendfile from it.
+ * Returns the descriptor or -1.
+ */
+int get_file_metadata(char file_path[], FileMetadata *metadata, int keep_open){
+	struct stat file_info;
+	int filefd;
+
+	if (metadata_cache_lookup(file_path, metadata)){
+		if (!keep_open || !metadata -> exists || metadata -> is_directory)
+			return -1;
+		/* the body is needed : only the open is left, unless the file vanished since */
+		filefd = open(file_path, O_RDONLY | O_CLOEXEC);
+		if (filefd >= 0)
+			return filefd;
+	}
+
+	memset(metadata, 0, sizeof(FileMetadata));
+	filefd = open(file_path, O_RDONLY | O_CLOEXEC);
+	if (filefd >= 0 && fstat(filefd, &file_info) == 0){
+		metadata -> exists = 1;
+		metadata -> is_directory = S_ISDIR(file_info.st_mode);
+		metadata -> size = file_info.st_size;
+		metadata -> mtime = file_info.st_mtime;
+		metadata -> inode = file_info.st_ino;
+		if (!metadata -> is_directory)
+			metadata -> header_length = build_header_fragment(metadata -> header, file_path, metadata -> size, metadata -> mtime, metadata -> inode);
+	}
+	else{
+		printf("Error in file opening : %s\n", file_path);
+	}
+	metadata_cache_insert(file_path, metadata);
+
+	if (filefd >= 0 && (!keep_open || metadata -> is_directory)){
+		close(filefd);
+		filefd = -1;
+	}
+	return filefd;
+}
+
+/*
+ * METADATA CACHE : COPY A FRESH ENTRY INTO metadata, RETURNS 0 IF THERE IS NONE
+ */
+int metadata_cache_lookup(char file_path[], FileMetadata *metadata){
+	unsigned long hash;
+	MetadataShard *shard;
+	MetadataEntry *entry;
+	int found = 0;
+
+	if (metadata_ttl <= 0)
+		return 0;
+	hash = hash_string(file_path);
+	shard = &metadata_shards[hash % METADATA_SHARDS];
+
+	pthread_rwlock_rdlock(&shard -> lock);
+	for (entry = shard -> buckets[(hash / METADATA_SHARDS) % METADATA_BUCKETS]; entry != NULL; entry = entry -> next){
+		if (entry -> hash == hash && strcmp(entry -> file_path, file_path) == 0){
+			if (entry -> expires > get_monotonic_ms()){
+				*metadata = entry -> metadata;
+				found = 1;
+			}
+			break;
+		}
+	}
+	pthread_rwlock_unlock(&shard -> lock);
+	return found;
+}
+
+/*
+ * METADATA CACHE : STORE OR REFRESH THE ENTRY OF A FILE, EXPIRED ENTRIES OF THE BUCKET ARE DROPPED ON THE WAY
+ */
+void metadata_cache_insert(char file_path[], FileMetadata *metadata){
+	unsigned long hash;
+	MetadataShard *shard;
+	MetadataEntry *entry, **link, *found = NULL;
+	long long now;
+
+	if (metadata_ttl <= 0)
+		return;
+	hash = hash_string(file_path);
+	shard = &metadata_shards[hash % METADATA_SHARDS];
+	now = get_monotonic_ms();
+
+	pthread_rwlock_wrlock(&shard -> lock);
+	link = &shard -> buckets[(hash / METADATA_SHARDS) % METADATA_BUCKETS];
+	while ((entry = *link) != NULL){
+		if (entry -> hash == hash && strcmp(entry -> file_path, file_path) == 0){
+			found = entry;
+			link = &entry -> next;
+		}
+		else if (entry -> expires <= now){
+			*link = entry -> next;
+			free(entry);
+			shard -> count--;
+		}
+		else{
+			link = &entry -> next;
+		}
+	}
+	if (found == NULL && shard -> count < METADATA_SHARD_ENTRIES){
+		found = (MetadataEntry *)malloc(sizeof(MetadataEntry));
+		strcpy(found -> file_path, file_path);
+		found -> hash = hash;
+		found -> next = shard -> buckets[(hash / METADATA_SHARDS) % METADATA_BUCKETS];
+		shard -> buckets[(hash / METADATA_SHARDS) % METADATA_BUCKETS] = found;
+		shard -> count++;
+	}
+	if (found != NULL){
+		found -> metadata = *metadata;
+		found -> expires = now + metadata_ttl;
+	}
+	pthread_rwlock_unlock(&shard -> lock);
+}
+
+void get_file_path(char file_path[], char file_name[], char current_dir[]){
+	/* file_path and current_dir are written whole by every branch below */
+	memset(dir_root, 0, sizeof(dir_root));
+	
+	/* Overwrite everything if tilde is present */
+	if (tilde_present){
+		memset(tilde_root, 0, sizeof(tilde_root));
+		strcat(tilde_root, "/home/");
+		strcat(tilde_root, tilde_user);
+		strcat(tilde_root, "/myhttpd/");
+		strcpy(current_dir, tilde_root);
+		strcat(tilde_root, file_name);
+		strcpy(file_path, tilde_root);
+		tilde_present = 0;
+	}
+	/* see for -r option */
+	else if (custom_root_dir){
+		strcat(dir_root, custom_dir);
+		if ( custom_dir[strlen(custom_dir) - 1] != '/')	
+			strcat(dir_root, "/");
+		strcpy(current_dir, dir_root);
+		strcat(dir_root, file_name);
+		strcpy(file_path, dir_root);
+	}
+	/* use the file name as the file path*/
+	else{
+		strcpy(current_dir, "./");
+		strcat(dir_root, file_name);
+		strcpy(file_path, dir_root);
+	}
+	if (debug)
+		printf("New File path : %s\n\n", file_path);
+}
+
+void get_content_type(char content_type[], char file_name[]){
+	char *file_extention = strrchr(file_name, '.');
+
+	/* files without a known extension are sent as plain text */
+	strcpy(content_type, "text/plain");
+	if (file_extention == NULL)
+		return;
+	file_extention++;
+	if ( (strcmp(file_extention, "txt") == 0) || (strcmp(file_extention, "html") == 0) ){
+		strcpy(content_type, "text/html");
+	}
+	
+	if ( (strcmp(file_extention, "gif") == 0) || (strcmp(file_extention, "jpg") == 0) || (strcmp(file_extention, "jpeg") == 0) ){
+		strcpy(content_type, "image/");
+		strcat(content_type, file_extention);
+	}
+}
+
+void get_file_name(Slice *path, char file_name[]){
+	int i = 0;
 	char *ptr;
+
+	/* remove the first '/' character prepended with the file name, the parser bounds the length */
+	memcpy(file_name, path -> start + 1, path -> length - 1);
+	file_name[path -> length - 1] = '\0';
+
+	/* test for presence of '~' in the file_name */
+	if( (ptr = strchr(file_name, '~')) != NULL ){
+		ptr++;
+		while(*ptr != '/' && *ptr != '\0' && i < (int)sizeof(tilde_user) - 1){
+			tilde_user[i] = *ptr;
+			ptr++; i++;
+		}
+		tilde_user[i] = '\0';
+		if (*ptr == '/')
+			ptr++;
+		memmove(file_name, ptr, strlen(ptr) + 1);
+		tilde_present = 1;
+	}
+}
+
+/*
+ * INSERT NODE INTO THE WAITING QUEUE OF THE CHOSEN SCHEDULING POLICY
+ */
+int insert_into_waiting_queue(Node *new_node){
+	Listener *listener = new_node -> connection -> listener;
+	int signal;
+
+	/* several listeners number their requests at once */
+	new_node -> sequence = __atomic_fetch_add(&waiting_sequence, 1, __ATOMIC_RELAXED);
+	new_node -> stage_ns[STAGE_ENQUEUED] = get_monotonic_ns();
+	if (shared_child != NULL)
+		__atomic_add_fetch(&shared_child -> queue_depth, 1, __ATOMIC_RELAXED);
+	if (use_SJF){
+		/* aging : every second spent waiting is worth sjf_aging bytes, so keying on the arrival time keeps the heap static */
+		new_node -> sjf_key = new_node -> file_size + sjf_aging * get_monotonic_ms() / 1000;
+	}
+	else if (use_EDF){
+		/* earliest deadline first : every request gets the same budget from its arrival, without -D that is arrival order */
+		new_node -> sjf_key = new_node -> stage_ns[STAGE_ACCEPTED] + request_deadline_ms * 1000000;
+	}
+	if (work_stealing){
+		/* there is no scheduler thread to signal */
+		new_node -> stage_ns[STAGE_DISPATCHED] = new_node -> stage_ns[STAGE_ENQUEUED];
+		dispatch_to_worker(new_node);
+		return 0;
+	}
+	__atomic_add_fetch(&waiting_queue_length, 1, __ATOMIC_RELAXED);
+	if (use_DRR){
+		signal = insert_into_fair_queue(&listener -> fair_queue, new_node);
+	}
+	else if (use_SJF || use_EDF){
+		signal = insert_into_heap(&listener -> waiting_heap, new_node);
+		/* the dump walks every waiting node under the lock : debugging only */
+		if (debug)
+			display_heap(&listener -> waiting_heap, "Waiting Queue");
+	}
+	else{
+		signal = insert_into_queue(&listener -> waiting_queue, new_node);
+		if (debug)
+			display_queue(&listener -> waiting_queue, "Waiting Queue");
+	}
+	return signal;
+}
+
+/*
+ * HAND A PARSED REQUEST TO ITS LISTENER'S QUEUE : THE LOCK IS ONLY HELD FOR THE INSERT ITSELF
+ * Parsing, the file lookups and the conditional GET checks are done by the caller without it.
+ */
+void enqueue_request(Node *new_node){
+	Listener *listener = new_node -> connection -> listener;
+	int signal;
+
+	if (work_stealing){
+		/* the worker inboxes are lock free */
+		insert_into_waiting_queue(new_node);
+		return;
+	}
+	pthread_mutex_lock(&listener -> waiting_queue_mutex);
+	signal = insert_into_waiting_queue(new_node);
+	pthread_mutex_unlock(&listener -> waiting_queue_mutex);
+	if (signal){
+		if (debug)
+			printf("Signaling the scheduler\n");
+		pthread_cond_signal(&listener -> waiting_queue_empty);
+	}
+}
+
+/*
+ * TAKE THE NEXT REQUEST OUT OF THE WAITING QUEUE OF listener BY THE SCHEDULING POLICY, CALLED WITH ITS LOCK HELD
+ */
+Node *dequeue_from_waiting_queue(Listener *listener){
+	Node *removed_node;
+
+	if(use_DRR){
+		removed_node = dequeue_using_DRR(&listener -> fair_queue);
+	}
+	else if(use_SJF || use_EDF){
+		removed_node = dequeue_using_SJF(&listener -> waiting_heap);
+		if (debug)
+			display_heap(&listener -> waiting_heap, "Waiting Queue");
+	}
+	else{
+		removed_node = dequeue_using_FCFS(&listener -> waiting_queue);
+		if (debug)
+			display_queue(&listener -> waiting_queue, "Waiting Queue");
+	}
+	__atomic_sub_fetch(&waiting_queue_length, 1, __ATOMIC_RELAXED);
+	return removed_node;
+}
+
+int waiting_queue_is_empty(Listener *listener){
+	if (use_DRR)
+		return listener -> fair_queue.size == 0;
+	if (use_SJF || use_EDF)
+		return listener -> waiting_heap.size == 0;
+	return listener -> waiting_queue.front == NULL && listener -> waiting_queue.rear == NULL;
+}
+
+long long get_monotonic_ms(){
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+long long get_monotonic_ns(){
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (long long)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/*
+ * READY RING : INITIALISE THE SLOT SEQUENCES SO THAT SLOT i IS FREE FOR THE i-TH PUSH
+ */
+void ready_ring_init(ReadyRing *ring){
+	unsigned long i;
+
+	memset(ring, 0, sizeof(ReadyRing));
+	for (i = 0; i < READY_RING_SIZE; i++)
+		ring -> slots[i].sequence = i;
+}
+
+/*
+ * PUSH A NODE, RETURNS 0 IF THE RING IS FULL
+ */
+int ready_ring_push(ReadyRing *ring, Node *new_node){
+	ReadySlot *slot;
+	unsigned long position, sequence;
+	long difference;
+
+	position = __atomic_load_n(&ring -> enqueue_position, __ATOMIC_RELAXED);
+	while(1){
+		slot = &ring -> slots[position & (READY_RING_SIZE - 1)];
+		sequence = __atomic_load_n(&slot -> sequence, __ATOMIC_ACQUIRE);
+		difference = (long)sequence - (long)position;
+		if (difference == 0){
+			/* the slot is free for this lap : claim the position */
+			if (__atomic_compare_exchange_n(&ring -> enqueue_position, &position, position + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		}
+		else if (difference < 0){
+			return 0;	/* the consumer of the previous lap has not emptied it yet */
+		}
+		else{
+			position = __atomic_load_n(&ring -> enqueue_position, __ATOMIC_RELAXED);
+		}
+	}
+	slot -> node = new_node;
+	__atomic_store_n(&slot -> sequence, position + 1, __ATOMIC_RELEASE);
+	return 1;
+}
+
+/*
+ * POP A NODE, RETURNS NULL IF THE RING IS EMPTY
+ */
+Node *ready_ring_pop(ReadyRing *ring){
+	ReadySlot *slot;
+	Node *node;
+	unsigned long position, sequence;
+	long difference;
+
+	position = __atomic_load_n(&ring -> dequeue_position, __ATOMIC_RELAXED);
+	while(1){
+		slot = &ring -> slots[position & (READY_RING_SIZE - 1)];
+		sequence = __atomic_load_n(&slot -> sequence, __ATOMIC_ACQUIRE);
+		difference = (long)sequence - (long)(position + 1);
+		if (difference == 0){
+			if (__atomic_compare_exchange_n(&ring -> dequeue_position, &position, position + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		}
+		else if (difference < 0){
+			return NULL;
+		}
+		else{
+			position = __atomic_load_n(&ring -> dequeue_position, __ATOMIC_RELAXED);
+		}
+	}
+	node = slot -> node;
+	/* hand the slot to the producer of the next lap */
+	__atomic_store_n(&slot -> sequence, position + READY_RING_SIZE, __ATOMIC_RELEASE);
+	return node;
+}
+
+/*
+ * INSERT NODE INTO THE READY QUEUE, PARKING WHILE IT IS FULL
+ */
+void insert_into_ready_queue(Node *new_node){
+	int word;
+
+	while (!ready_ring_push(&ready_queue, new_node)){
+		printf("Scheduler(): Ready queue is full => WAIT !\n");
+		word = __atomic_load_n(&ready_queue.not_full.word, __ATOMIC_SEQ_CST);
+		__atomic_add_fetch(&ready_queue.not_full.sleepers, 1, __ATOMIC_SEQ_CST);
+		if (!ready_ring_push(&ready_queue, new_node)){
+			park(&ready_queue.not_full, word);
+			__atomic_sub_fetch(&ready_queue.not_full.sleepers, 1, __ATOMIC_SEQ_CST);
+			continue;
+		}
+		__atomic_sub_fetch(&ready_queue.not_full.sleepers, 1, __ATOMIC_SEQ_CST);
+		break;
+	}
+	unpark(&ready_queue.not_empty);
+}
+
+/*
+ * PARK THE SCHEDULER WHILE THE RING HOLDS A REQUEST FOR EVERY RUNNING WORKER
+ * The choice among waiting requests is then made when a worker frees up, not long before
+ */
+void wait_for_ready_slot(){
+	long depth, workers;
+	int word;
+
+	while (1){
+		word = __atomic_load_n(&ready_queue.not_full.word, __ATOMIC_SEQ_CST);
+		workers = __atomic_load_n(&pool_target, __ATOMIC_SEQ_CST);
+		if (workers > worker_max)
+			workers = worker_max;
+		depth = (long)(__atomic_load_n(&ready_queue.enqueue_position, __ATOMIC_SEQ_CST) - __atomic_load_n(&ready_queue.dequeue_position, __ATOMIC_SEQ_CST));
+		if (depth < workers)
+			return;
+		__atomic_add_fetch(&ready_queue.not_full.sleepers, 1, __ATOMIC_SEQ_CST);
+		depth = (long)(__atomic_load_n(&ready_queue.enqueue_position, __ATOMIC_SEQ_CST) - __atomic_load_n(&ready_queue.dequeue_position, __ATOMIC_SEQ_CST));
+		if (depth >= workers)
+			park(&ready_queue.not_full, word);
+		__atomic_sub_fetch(&ready_queue.not_full.sleepers, 1, __ATOMIC_SEQ_CST);
+	}
+}
+
+/*
+ * DEQUEUE A NODE FROM THE READY QUEUE, PARKING THE WORKER WHILE IT IS EMPTY
+ * The sleeper count is raised before the last look at the ring, so a push either
+ * is seen by that look or sees the sleeper and bumps the futex word
+ */
+Node *dequeue_from_ready_queue(int worker_id){
+	Node *node;
+	int word;
+
+	while(1){
+		node = ready_ring_pop(&ready_queue);
+		if (node != NULL)
+			break;
+
+		word = __atomic_load_n(&ready_queue.not_empty.word, __ATOMIC_SEQ_CST);
+		/* the pool shrank below this worker : checked after reading the word so the wake up is not missed */
+		if (worker_id >= __atomic_load_n(&pool_target, __ATOMIC_SEQ_CST) && worker_leaves(worker_id))
+			return NULL;
+		__atomic_add_fetch(&ready_queue.not_empty.sleepers, 1, __ATOMIC_SEQ_CST);
+		node = ready_ring_pop(&ready_queue);
+		if (node == NULL){
+			printf("Worker(): Nothing to serve => WAIT !\n");
+			park(&ready_queue.not_empty, word);
+		}
+		__atomic_sub_fetch(&ready_queue.not_empty.sleepers, 1, __ATOMIC_SEQ_CST);
+		if (node != NULL)
+			break;
+	}
+	unpark(&ready_queue.not_full);
+	return node;
+}
+
+/*
+ * SLEEP ON THE FUTEX WORD UNLESS IT HAS MOVED SINCE word WAS READ
+ */
+void park(Parking *parking, int word){
+	syscall(SYS_futex, &parking -> word, FUTEX_WAIT_PRIVATE, word, NULL, NULL, 0);
+}
+
+/*
+ * LIKE park BUT GIVE UP AFTER THE GIVEN NUMBER OF MILLISECONDS
+ */
+void park_timeout(Parking *parking, int word, long long milliseconds){
+	struct timespec timeout;
+
+	timeout.tv_sec = milliseconds / 1000;
+	timeout.tv_nsec = (milliseconds % 1000) * 1000000;
+	__atomic_add_fetch(&parking -> sleepers, 1, __ATOMIC_SEQ_CST);
+	syscall(SYS_futex, &parking -> word, FUTEX_WAIT_PRIVATE, word, &timeout, NULL, 0);
+	__atomic_sub_fetch(&parking -> sleepers, 1, __ATOMIC_SEQ_CST);
+}
+
+/*
+ * BUMP THE FUTEX WORD AND WAKE ONE SLEEPER, THE SYSCALL IS SKIPPED WHEN NOBODY SLEEPS
+ */
+void unpark(Parking *parking){
+	__atomic_add_fetch(&parking -> word, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&parking -> sleepers, __ATOMIC_SEQ_CST) > 0)
+		syscall(SYS_futex, &parking -> word, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+/* bump the futex word and wake every sleeper */
+void unpark_all(Parking *parking){
+	__atomic_add_fetch(&parking -> word, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&parking -> sleepers, __ATOMIC_SEQ_CST) > 0)
+		syscall(SYS_futex, &parking -> word, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+/*
+ * WORK STEALING : PUSH THE REQUEST ONTO THE INBOX OF A WORKER
+ * SJF picks the worker with the fewest queued bytes, FCFS the one with the fewest queued requests
+ */
+void dispatch_to_worker(Node *new_node){
+	WorkerQueue *worker_queue;
+	int i, chosen = __atomic_fetch_add(&next_worker, 1, __ATOMIC_RELAXED) % THREADNUM;
+	long load, chosen_load;
+
+	/* start the search at a rotating worker so that ties are spread round robin */
+	chosen_load = use_SJF ? worker_queues[chosen].queued_bytes : worker_queues[chosen].queued_count;
+	for (i = 0; i < THREADNUM; i++){
+		load = use_SJF ? __atomic_load_n(&worker_queues[i].queued_bytes, __ATOMIC_RELAXED) : __atomic_load_n(&worker_queues[i].queued_count, __ATOMIC_RELAXED);
+		if (load < chosen_load){
+			chosen = i;
+			chosen_load = load;
+		}
+	}
+
+	worker_queue = &worker_queues[chosen];
+	new_node -> worker_id = chosen;
+	__atomic_add_fetch(&worker_queue -> queued_count, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&worker_queue -> queued_bytes, new_node -> file_size, __ATOMIC_RELAXED);
+
+	/* lock free push onto the inbox stack */
+	new_node -> next = __atomic_load_n(&worker_queue -> inbox, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&worker_queue -> inbox, &new_node -> next, new_node, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+		;
+	if (debug)
+		printf("Listener(): dispatched to worker %d\n", chosen);
+	unpark(&worker_queue -> parking);
+}
+
+/*
+ * WORK STEALING : NEXT REQUEST FOR THE WORKER, FROM ITS OWN DEQUE, ITS INBOX OR ANOTHER WORKER
+ */
+Node *dequeue_from_worker_queue(int worker_id){
+	WorkerQueue *worker_queue = &worker_queues[worker_id];
+	Node *node;
+	int word, i;
+
+	while(1){
+		node = worker_deque_pop(worker_queue);
+		if (node == NULL && refill_worker_deque(worker_queue) > 0){
+			node = worker_deque_pop(worker_queue);
+			/* more than one job is now queued here : let an idle worker steal one */
+			for (i = 0; i < THREADNUM; i++){
+				if (i != worker_id && __atomic_load_n(&worker_queues[i].parking.sleepers, __ATOMIC_SEQ_CST) > 0){
+					unpark(&worker_queues[i].parking);
+					break;
+				}
+			}
+		}
+		if (node == NULL)
+			node = steal_from_workers(worker_id);
+		if (node != NULL)
+			break;
+
+		word = __atomic_load_n(&worker_queue -> parking.word, __ATOMIC_SEQ_CST);
+		__atomic_add_fetch(&worker_queue -> parking.sleepers, 1, __ATOMIC_SEQ_CST);
+		if (!work_is_available(worker_id)){
+			if (debug)
+				printf("Worker(): Nothing to serve => WAIT !\n");
+			park(&worker_queue -> parking, word);
+		}
+		__atomic_sub_fetch(&worker_queue -> parking.sleepers, 1, __ATOMIC_SEQ_CST);
+	}
+
+	__atomic_sub_fetch(&worker_queues[node -> worker_id].queued_count, 1, __ATOMIC_RELAXED);
+	__atomic_sub_fetch(&worker_queues[node -> worker_id].queued_bytes, node -> file_size, __ATOMIC_RELAXED);
+	return node;
+}
+
+/*
+ * MOVE THE WHOLE INBOX ONTO THE OWN DEQUE IN POLICY ORDER, RETURNS THE NUMBER OF NODES MOVED
+ * The deque is popped from the bottom, so the job to run first is pushed last
+ */
+int refill_worker_deque(WorkerQueue *worker_queue){
+	Node *iterator, **batch;
+	int count = 0, kept, i;
+	long space;
+
+	iterator = __atomic_exchange_n(&worker_queue -> inbox, NULL, __ATOMIC_ACQUIRE);
+	if (iterator == NULL)
+		return 0;
+
+	/* the batch array belongs to the worker and only ever grows */
+	for (; iterator != NULL; iterator = iterator -> next){
+		if (count == worker_queue -> batch_capacity){
+			worker_queue -> batch_capacity = (count == 0) ? 64 : 2 * count;
+			worker_queue -> batch = (Node **)realloc(worker_queue -> batch, worker_queue -> batch_capacity * sizeof(Node *));
+		}
+		worker_queue -> batch[count++] = iterator;
+	}
+	batch = worker_queue -> batch;
+	qsort(batch, count, sizeof(Node *), compare_nodes);
+
+	/* only the owner pushes and thieves only free slots, so this much room is there for sure */
+	space = WORKER_DEQUE_SIZE - (__atomic_load_n(&worker_queue -> bottom, __ATOMIC_RELAXED) - __atomic_load_n(&worker_queue -> top, __ATOMIC_ACQUIRE));
+	kept = (count < space) ? count : space;
+	for (i = kept - 1; i >= 0; i--){
+		batch[i] -> next = NULL;
+		worker_deque_push(worker_queue, batch[i]);
+	}
+	/* the deque is full : the jobs to run last go back to the inbox for the next refill */
+	for (i = kept; i < count; i++){
+		batch[i] -> next = __atomic_load_n(&worker_queue -> inbox, __ATOMIC_RELAXED);
+		while (!__atomic_compare_exchange_n(&worker_queue -> inbox, &batch[i] -> next, batch[i], 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+			;
+	}
+	return kept;
+}
+
+/*
+ * POLICY ORDER INSIDE A BATCH : SJF AND EDF ON sjf_key, FCFS ON ARRIVAL
+ */
+int compare_nodes(const void *first, const void *second){
+	Node *first_node = *(Node **)first, *second_node = *(Node **)second;
+
+	if (use_SJF || use_EDF)
+		return heap_node_before(first_node, second_node) ? -1 : 1;
+	return (first_node -> sequence < second_node -> sequence) ? -1 : 1;
+}
+
+Node *steal_from_workers(int worker_id){
+	Node *node;
+	int i;
+
+	for (i = 1; i < THREADNUM; i++){
+		node = worker_deque_steal(&worker_queues[(worker_id + i) % THREADNUM]);
+		if (node != NULL){
+			if (debug)
+				printf("Worker(): worker %d stole a request from worker %d\n", worker_id, (worker_id + i) % THREADNUM);
+			return node;
+		}
+	}
+	return NULL;
+}
+
+int work_is_available(int worker_id){
+	int i;
+
+	if (__atomic_load_n(&worker_queues[worker_id].inbox, __ATOMIC_SEQ_CST) != NULL)
+		return 1;
+	for (i = 0; i < THREADNUM; i++){
+		if (__atomic_load_n(&worker_queues[i].top, __ATOMIC_SEQ_CST) < __atomic_load_n(&worker_queues[i].bottom, __ATOMIC_SEQ_CST))
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * CHASE-LEV DEQUE : ONLY THE OWNER PUSHES AND POPS AT THE BOTTOM, ANY WORKER STEALS AT THE TOP
+ */
+int worker_deque_push(WorkerQueue *worker_queue, Node *new_node){
+	long bottom, top;
+
+	bottom = __atomic_load_n(&worker_queue -> bottom, __ATOMIC_RELAXED);
+	top = __atomic_load_n(&worker_queue -> top, __ATOMIC_ACQUIRE);
+	if (bottom - top >= WORKER_DEQUE_SIZE)
+		return 0;
+	__atomic_store_n(&worker_queue -> deque[bottom & (WORKER_DEQUE_SIZE - 1)], new_node, __ATOMIC_RELAXED);
+	__atomic_store_n(&worker_queue -> bottom, bottom + 1, __ATOMIC_RELEASE);
+	return 1;
+}
+
+Node *worker_deque_pop(WorkerQueue *worker_queue){
+	long bottom, top;
+	Node *node = NULL;
+
+	bottom = __atomic_load_n(&worker_queue -> bottom, __ATOMIC_RELAXED) - 1;
+	__atomic_store_n(&worker_queue -> bottom, bottom, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	top = __atomic_load_n(&worker_queue -> top, __ATOMIC_RELAXED);
+
+	if (top <= bottom){
+		node = __atomic_load_n(&worker_queue -> deque[bottom & (WORKER_DEQUE_SIZE - 1)], __ATOMIC_RELAXED);
+		if (top == bottom){
+			/* last job : race the thieves for it */
+			if (!__atomic_compare_exchange_n(&worker_queue -> top, &top, top + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+				node = NULL;
+			__atomic_store_n(&worker_queue -> bottom, bottom + 1, __ATOMIC_RELAXED);
+		}
+	}
+	else{
+		__atomic_store_n(&worker_queue -> bottom, bottom + 1, __ATOMIC_RELAXED);
+	}
+	return node;
+}
+
+Node *worker_deque_steal(WorkerQueue *worker_queue){
+	long bottom, top;
+	Node *node;
+
+	top = __atomic_load_n(&worker_queue -> top, __ATOMIC_ACQUIRE);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	bottom = __atomic_load_n(&worker_queue -> bottom, __ATOMIC_ACQUIRE);
+	if (top >= bottom)
+		return NULL;
+
+	node = __atomic_load_n(&worker_queue -> deque[top & (WORKER_DEQUE_SIZE - 1)], __ATOMIC_RELAXED);
+	if (!__atomic_compare_exchange_n(&worker_queue -> top, &top, top + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+		return NULL;	/* lost the race to the owner or another thief */
+	return node;
+}
+
+/* 
+ * INSERT NODE INTO THE SPECIFIED QUEUE 
+ */
+int insert_into_queue(Queue *queue, Node *new_node){
+	int signal = 0;
+
+	if (queue -> front == NULL && queue -> rear == NULL){   /* If queue is empty */
+		queue -> front = new_node;
+		queue -> rear = new_node;
+		signal = 1;
+	}
+	else{
+		new_node -> next = queue -> front;
+		queue -> front -> previous = new_node;
+		queue -> front = new_node;
+	}
+	return signal;
+}
+
+/*
+ * INSERT NODE INTO THE SUB-QUEUE OF ITS CLIENT, ADDING THE CLIENT TO THE ACTIVE LIST IF IT HAD NOTHING WAITING
+ */
+int insert_into_fair_queue(FairQueue *fair_queue, Node *new_node){
+	ClientQueue *client, **bucket = &fair_queue -> buckets[hash_string(new_node -> client_ip) % CLIENT_BUCKETS];
+	int signal = (fair_queue -> size == 0);
+
+	for (client = *bucket; client != NULL && strcmp(client -> client_ip, new_node -> client_ip) != 0; client = client -> hash_next);
+	if (client == NULL){
+		client = (ClientQueue *)pool_alloc(&client_queue_pool, &client_queue_pool_cache);
+		memset(client, 0, sizeof(ClientQueue));
+		strcpy(client -> client_ip, new_node -> client_ip);
+		client -> hash_next = *bucket;
+		*bucket = client;
+		fair_queue -> clients++;
+		/* a new client queues behind the ones already waiting */
+		if (fair_queue -> active_tail == NULL)
+			fair_queue -> active_head = client;
+		else
+			fair_queue -> active_tail -> active_next = client;
+		fair_queue -> active_tail = client;
+	}
+	insert_into_queue(&client -> queue, new_node);
+	client -> backlog_requests++;
+	client -> backlog_bytes += new_node -> file_size;
+	fair_queue -> size++;
+	return signal;
+}
+
+/*
+ * DEQUEUE USING DRR : O(1) PER REQUEST WHILE REQUESTS FIT IN drr_quantum, LARGER ONES TAKE A FEW MORE TURNS
+ * A lone client is served whatever its credit : there is nobody to be fair to.
+ */
+Node *dequeue_using_DRR(FairQueue *fair_queue){
+	ClientQueue *client, **link;
+	Node *node;
+	long cost;
+
+	while (1){
+		client = fair_queue -> active_head;
+		if (!client -> in_turn){
+			client -> deficit += drr_quantum;
+			client -> in_turn = 1;
+		}
+		cost = client -> queue.rear -> file_size + DRR_REQUEST_COST;
+		if (cost <= client -> deficit || client == fair_queue -> active_tail)
+			break;
+
+		/* turn over : the credit carries to the next round */
+		client -> in_turn = 0;
+		fair_queue -> active_head = client -> active_next;
+		client -> active_next = NULL;
+		fair_queue -> active_tail -> active_next = client;
+		fair_queue -> active_tail = client;
+	}
+
+	node = dequeue_using_FCFS(&client -> queue);
+	client -> deficit = (cost <= client -> deficit) ? client -> deficit - cost : 0;
+	client -> backlog_requests--;
+	client -> backlog_bytes -= node -> file_size;
+	fair_queue -> size--;
+	if (client -> backlog_requests > 0)
+		return node;
+
+	/* nothing left for this client : it loses its credit and its entry */
+	fair_queue -> active_head = client -> active_next;
+	if (fair_queue -> active_head == NULL)
+		fair_queue -> active_tail = NULL;
+	for (link = &fair_queue -> buckets[hash_string(client -> client_ip) % CLIENT_BUCKETS]; *link != client; link = &(*link) -> hash_next);
+	*link = client -> hash_next;
+	fair_queue -> clients--;
+	pool_free(&client_queue_pool, &client_queue_pool_cache, client);
+	return node;
+}
+
+/* 
+ * SCHEDULER ROUTINE BEGINS 
+ */
+void scheduler_routine(void *listener_argument){
+	Listener *listener = (Listener *)listener_argument;
+	Node *removed_node;
+
+	printf("Inside scheduler %d\n", listener -> id);
+	while(1){
+		/* SJF, EDF and DRR pick among the waiting requests : a full ring would serve them in dispatch order instead */
+		if (use_SJF || use_EDF || use_DRR)
+			wait_for_ready_slot();
+
+		pthread_mutex_lock(&listener -> waiting_queue_mutex);
+		if (debug)
+			printf("Scheduler(): acquired the lock\n");
+		while (waiting_queue_is_empty(listener)){
+			printf("scheduler(): Nothing to schedule => WAIT !\n");
+			pthread_cond_wait(&listener -> waiting_queue_empty, &listener -> waiting_queue_mutex);
+		}
+
+		/* Take the lock on waiting queue and remove the item from it */	
+		removed_node = dequeue_from_waiting_queue(listener);
+		pthread_mutex_unlock(&listener -> waiting_queue_mutex);
+		removed_node -> stage_ns[STAGE_DISPATCHED] = get_monotonic_ns();
+		if (debug)
+			printf("Scheduler(): released the lock\n");
+
+		/* insert the item into the ready ring : blocks only while the ring is full */
+		insert_into_ready_queue(removed_node);
+	}
+}
+
+/*
+ * WORKER ROUTINE
+ */
+void worker_routine(void *worker_number){
+	int worker_id = (int)(long) worker_number;
+	Node *removed_node;
+	//unsigned char buffer[16385];
+	/* response buffers live for the whole life of the worker */
+	char header[500];
+	char http_status[20], current_timestamp[30], last_modified[30], char_file_size[80], first_line_of_request[200], date_line[DATE_LINE_SIZE], etag_line[ETAG_SIZE + 8];
+	char *status_buffer = NULL, *body;
+	int status_length = 0, iov_count, file_body, streamed, ranged, result;
+	long body_length, content_length;
+	struct iovec iov[4];
+
+	/* placed before anything of the worker is allocated, then take over what a retired worker of this slot left */
+	if (worker_affinity != AFFINITY_NONE)
+		place_worker(worker_id);
+	log_ring = worker_slots[worker_id].log_ring;
+	stage_histograms = worker_slots[worker_id].histograms;
 	
-	while(request[i] != ' '){ i++; }
-	i++;
-	while(request[i] != ' '){
-		file_name[j] = request[i];
-		i++; j++;
+	while(1){
+		/* Dequeue the Ready queue : no shared lock is held while the request is served */
+		if (work_stealing)
+			removed_node = dequeue_from_worker_queue(worker_id);
+		else
+			removed_node = dequeue_from_ready_queue(worker_id);
+		if (removed_node == NULL)
+			break;
+		removed_node -> stage_ns[STAGE_DEQUEUED] = get_monotonic_ns();
+		if (debug){
+			printf("Here Removed Node is : \n");
+			print_node(removed_node);
+		}
+
+		/* past its deadline : the client is told to come back, nothing of the file is read or sent */
+		if (request_deadline_ms > 0 && !removed_node -> server_status && removed_node -> stage_ns[STAGE_DEQUEUED] - removed_node -> stage_ns[STAGE_ACCEPTED] > request_deadline_ms * 1000000){
+			__atomic_add_fetch(&requests_shed_expired, 1, __ATOMIC_RELAXED);
+			reject_request(removed_node -> connection, RESPONSE_SERVICE_UNAVAILABLE);
+			removed_node -> keep_alive = 0;
+			release_node_resources(removed_node);
+			if (shared_child != NULL)
+				__atomic_sub_fetch(&shared_child -> queue_depth, 1, __ATOMIC_RELAXED);
+			__atomic_sub_fetch(&admitted_requests, 1, __ATOMIC_RELAXED);
+			finish_request(removed_node);
+			free_queue_node(removed_node);
+			continue;
+		}
+
+		/* first request for the gzip variant of the file : compress it now, outside any shared lock */
+		if (removed_node -> compress_pending){
+			removed_node -> variant = variant_fill(removed_node);
+			if (removed_node -> variant != NULL && removed_node -> variant -> length < 0){
+				variant_release(removed_node -> variant);
+				removed_node -> variant = NULL;
+			}
+			if (removed_node -> variant != NULL)
+				set_content_encoding(removed_node, "gzip", removed_node -> variant -> length);
+		}
+
+		/* status line : it decides which body goes out */
+		if (removed_node -> server_status){
+			if (status_buffer == NULL)
+				status_buffer = (char *)malloc(STATUS_BUFFER_SIZE);
+			status_length = build_server_status(status_buffer, STATUS_BUFFER_SIZE);
+			removed_node -> file_size = status_length;
+			removed_node -> metadata.mtime = time(NULL);
+			removed_node -> metadata.exists = 1;
+			strcpy(http_status, "200 OK");
+			removed_node -> file_not_found = 0;
+		}
+		else if (removed_node -> not_modified){
+			strcpy(http_status, "304 Not Modified");
+			removed_node -> file_not_found = 0;
+		}
+		else if (removed_node -> cache_entry != NULL){
+			strcpy(http_status, "200 OK");
+			removed_node -> file_not_found = 0;
+		}
+		else{
+			get_http_status(removed_node, http_status);
+			/* cache miss : read the file into the cache and serve it from there */
+			if (cache_capacity > 0 && !removed_node -> file_not_found && removed_node -> range_count == 0 && removed_node -> content_encoding == NULL && removed_node -> archive_entry == NULL && strcmp(removed_node -> request_type, "GET") == 0){
+				removed_node -> cache_entry = cache_fill(removed_node -> file_path);
+				if (removed_node -> cache_entry != NULL)
+					removed_node -> file_size = removed_node -> cache_entry -> size;
+			}
+		}
+
+		ranged = (removed_node -> range_count != 0 && !removed_node -> file_not_found);
+		if (ranged)
+			strcpy(http_status, (removed_node -> range_count > 0) ? "206 Partial Content" : "416 Range Not Satisfiable");
+
+		/* body kept in memory, if any : a file body is sent with sendfile after the header */
+		body = NULL;
+		body_length = 0;
+		streamed = 0;
+		if (removed_node -> file_not_found){
+			/* 404 File NOT FOUND : the cached listing of the directory, or a streamed one if it is too large */
+			printf("Error in opening the file !\n");
+			removed_node -> listing = get_directory_listing(removed_node -> current_dir);
+			if (removed_node -> listing != NULL){
+				body = removed_node -> listing -> content;
+				body_length = removed_node -> listing -> length;
+				if (debug)
+					printf("Buffer Length is : %ld\n\n", body_length);
+			}
+			else{
+				streamed = 1;
+				/* without chunked encoding only the end of the connection can tell where the body stops */
+				if (!removed_node -> http_1_1)
+					removed_node -> keep_alive = 0;
+			}
+		}
+		else if (removed_node -> server_status){
+			body = status_buffer;
+			body_length = status_length;
+		}
+		else if (removed_node -> variant != NULL){
+			body = removed_node -> variant -> content;
+			body_length = removed_node -> variant -> length;
+		}
+		else if (removed_node -> archive_entry != NULL && !ranged){
+			/* straight from the mapping : no copy in user space */
+			body = archive_base + removed_node -> archive_entry -> offset;
+			body_length = removed_node -> archive_entry -> size;
+		}
+		else if (removed_node -> cache_entry != NULL && !ranged){
+			body = removed_node -> cache_entry -> content;
+			body_length = removed_node -> cache_entry -> size;
+		}
+		content_length = (body != NULL) ? body_length : removed_node -> file_size;
+
+		/* header : the file's pre-serialised fragment when it still describes what is sent, else built once here */
+		etag_line[0] = '\0';
+		if (!removed_node -> file_not_found && !removed_node -> server_status){
+			strcpy(etag_line, "ETag: ");
+			format_etag(etag_line + 6, removed_node -> metadata.inode, removed_node -> metadata.size, removed_node -> metadata.mtime, removed_node -> content_encoding);
+			strcat(etag_line, "\n");
+		}
+		if (removed_node -> not_modified){
+			/* no Content-Length : it would describe the body the client already holds */
+			get_last_modified_time_of_file(last_modified, removed_node);
+			iov[0].iov_base = header;
+			iov[0].iov_len = snprintf(header, sizeof(header), "HTTP/1.1 %s\nServer: myhttpd-ketan 1.0\nLast-Modified: %s\n%s%s", http_status, last_modified, etag_line, is_compressible(removed_node -> content_type) ? "Vary: Accept-Encoding\n" : "");
+		}
+		else if (ranged){
+			iov[0].iov_base = header;
+			iov[0].iov_len = build_range_header(header, sizeof(header), removed_node, http_status, &content_length);
+		}
+		else if (removed_node -> content_encoding != NULL){
+			get_last_modified_time_of_file(last_modified, removed_node);
+			iov[0].iov_base = header;
+			iov[0].iov_len = snprintf(header, sizeof(header), "HTTP/1.1 %s\nServer: myhttpd-ketan 1.0\nLast-Modified: %s\n%sContent-Type: %s\nContent-Encoding: %s\nVary: Accept-Encoding\nContent-Length: %ld\n", http_status, last_modified, etag_line, removed_node -> content_type, removed_node -> content_encoding, content_length);
+		}
+		else if (removed_node -> cache_entry != NULL){
+			iov[0].iov_base = removed_node -> cache_entry -> header;
+			iov[0].iov_len = removed_node -> cache_entry -> header_length;
+		}
+		else if (!removed_node -> file_not_found && !removed_node -> server_status && removed_node -> metadata.header_length > 0 && removed_node -> file_size == removed_node -> metadata.size){
+			iov[0].iov_base = removed_node -> metadata.header;
+			iov[0].iov_len = removed_node -> metadata.header_length;
+		}
+		else if (streamed){
+			iov[0].iov_base = header;
+			iov[0].iov_len = snprintf(header, sizeof(header), "HTTP/1.1 %s\nServer: myhttpd-ketan 1.0\nContent-Type: %s\n%s", http_status, removed_node -> content_type, removed_node -> http_1_1 ? "Transfer-Encoding: chunked\n" : "");
+		}
+		else{
+			get_last_modified_time_of_file(last_modified, removed_node);
+			iov[0].iov_base = header;
+			iov[0].iov_len = snprintf(header, sizeof(header), "HTTP/1.1 %s\nServer: myhttpd-ketan 1.0\nLast-Modified: %s\n%sContent-Type: %s\nContent-Length: %ld\n", http_status, last_modified, etag_line, removed_node -> content_type, content_length);
+		}
+		get_cached_date(date_line);
+		iov[1].iov_base = date_line;
+		iov[1].iov_len = strlen(date_line);
+		if (removed_node -> keep_alive){
+			iov[2].iov_base = "Connection: keep-alive\n\n";	/* extra blank line required */
+			iov[2].iov_len = 24;
+		}
+		else{
+			iov[2].iov_base = "Connection: close\n\n";
+			iov[2].iov_len = 19;
+		}
+		iov_count = 3;
+		if (body != NULL && body_length > 0 && strcmp(removed_node -> request_type, "HEAD") != 0){
+			iov[3].iov_base = body;
+			iov[3].iov_len = body_length;
+			iov_count = 4;
+		}
+
+		/* appende to log file */
+		if (create_log){
+			get_current_time(current_timestamp);
+			sprintf(char_file_size, "%ld", content_length);
+			memset(first_line_of_request, 0, sizeof(first_line_of_request));
+			strcat(first_line_of_request, removed_node -> request_type);
+			strcat(first_line_of_request, " ");
+			strcat(first_line_of_request, removed_node -> file_name);
+			strcat(first_line_of_request, " HTTP/1.0");
+			append_to_log_file(removed_node -> client_ip, removed_node -> arrival_time, current_timestamp, first_line_of_request, http_status, char_file_size);
+		}
+		
+		/* one sendmsg for the header and any in memory body, then a file body straight from the page cache */
+		removed_node -> stage_ns[STAGE_FIRST_BYTE] = get_monotonic_ns();
+		file_body = (body == NULL && !streamed && !ranged && removed_node -> file_size > 0);
+		result = send_iovec(removed_node -> acceptfd, iov, iov_count, file_body || streamed || ranged);
+		if (result == 0 && ranged){
+			result = send_ranges(removed_node);
+		}
+		else if (result == 0 && streamed && strcmp(removed_node -> request_type, "HEAD") != 0){
+			result = stream_directory_listing(removed_node -> acceptfd, removed_node -> current_dir, removed_node -> http_1_1);
+		}
+		else if (result == 0 && file_body){
+			result = send_file_content(removed_node -> acceptfd, removed_node -> filefd, removed_node -> file_path, 0, removed_node -> file_size);
+		}
+		/* the client stopped reading or went away : its connection is closed instead of kept alive */
+		if (result != 0)
+			removed_node -> keep_alive = 0;
+		release_node_resources(removed_node);
+		removed_node -> stage_ns[STAGE_LAST_BYTE] = get_monotonic_ns();
+		record_request_stages(removed_node);
+		__atomic_store_n(&worker_busy_ns[worker_id], worker_busy_ns[worker_id] + removed_node -> stage_ns[STAGE_LAST_BYTE] - removed_node -> stage_ns[STAGE_DEQUEUED], __ATOMIC_RELAXED);
+		if (shared_child != NULL){
+			__atomic_add_fetch(&shared_child -> requests, 1, __ATOMIC_RELAXED);
+			if (!removed_node -> not_modified && strcmp(removed_node -> request_type, "HEAD") != 0)
+				__atomic_add_fetch(&shared_child -> bytes, content_length, __ATOMIC_RELAXED);
+			__atomic_sub_fetch(&shared_child -> queue_depth, 1, __ATOMIC_RELAXED);
+		}
+		__atomic_sub_fetch(&admitted_requests, 1, __ATOMIC_RELAXED);
+
+		/* close the connection or return it to the read path */
+		finish_request(removed_node);
+		free_queue_node(removed_node);
+	}
+
+	/* retired by the pool manager : the next worker of this slot carries on with the same ring and histograms */
+	printf("Worker(): worker %d retires\n", worker_id);
+	worker_slots[worker_id].log_ring = log_ring;
+	worker_slots[worker_id].histograms = stage_histograms;
+	/* the nodes and connections this worker freed would be stranded with its thread */
+	pool_flush(&node_pool, &node_pool_cache);
+	pool_flush(&connection_pool, &connection_pool_cache);
+	free(status_buffer);
+}
+
+/*
+ * GIVE BACK WHAT THE REQUEST HELD : FILE DESCRIPTOR, CACHE ENTRY, LISTING AND GZIP VARIANT
+ */
+void release_node_resources(Node *node){
+	if (node -> filefd >= 0){
+		close(node -> filefd);
+		node -> filefd = -1;
+	}
+	if (node -> cache_entry != NULL){
+		cache_release(node -> cache_entry);
+		node -> cache_entry = NULL;
+		if (debug)
+			display_cache_statistics();
+	}
+	if (node -> listing != NULL){
+		release_directory_listing(node -> listing);
+		node -> listing = NULL;
+	}
+	if (node -> variant != NULL){
+		variant_release(node -> variant);
+		node -> variant = NULL;
+	}
+}
+
+/*
+ * WORKER POOL : A WORKER ABOVE pool_target DECIDES TO LEAVE, UNLESS THE POOL GREW BACK IN THE MEANTIME
+ */
+int worker_leaves(int worker_id){
+	WorkerSlot *slot = &worker_slots[worker_id];
+	int leaves;
+
+	pthread_mutex_lock(&slot -> mutex);
+	leaves = (worker_id >= __atomic_load_n(&pool_target, __ATOMIC_SEQ_CST));
+	if (leaves)
+		slot -> leaving = 1;
+	pthread_mutex_unlock(&slot -> mutex);
+	return leaves;
+}
+
+/*
+ * WORKER POOL : START WORKER worker_id, REUSING THE SLOT OF A WORKER WHICH RETIRED EARLIER
+ * A retired worker still busy with its last request has not left yet : it simply stays, so the
+ * pool manager never waits behind a long request. Only a thread which left is joined, and it
+ * has nothing left to do by then but hand over its log ring and histograms.
+ */
+void start_worker(int worker_id){
+	WorkerSlot *slot = &worker_slots[worker_id];
+
+	pthread_mutex_lock(&slot -> mutex);
+	if (slot -> started && slot -> leaving == 0){
+		__atomic_store_n(&pool_target, worker_id + 1, __ATOMIC_SEQ_CST);
+		pthread_mutex_unlock(&slot -> mutex);
+		printf("Pool manager(): worker %d had not left yet, it stays\n", worker_id);
+		return;
+	}
+	if (slot -> started){
+		pthread_join(slot -> thread, NULL);
+		slot -> started = 0;
+		slot -> leaving = 0;
+	}
+	__atomic_store_n(&pool_target, worker_id + 1, __ATOMIC_SEQ_CST);
+	if (pthread_create(&slot -> thread, NULL, (void *) &worker_routine, (void *)(long) worker_id) != 0){
+		perror("Error creating the worker thread\n");
+		__atomic_store_n(&pool_target, worker_id, __ATOMIC_SEQ_CST);
+		pthread_mutex_unlock(&slot -> mutex);
+		return;
+	}
+	slot -> started = 1;
+	pthread_mutex_unlock(&slot -> mutex);
+}
+
+/*
+ * WORKER POOL : RETIRE THE WORKER WITH THE HIGHEST ID, IT LEAVES AFTER ITS CURRENT REQUEST
+ * Every parked worker is woken so that the retiring one notices, the others park again
+ */
+void retire_worker(){
+	__atomic_sub_fetch(&pool_target, 1, __ATOMIC_SEQ_CST);
+	unpark_all(&ready_queue.not_empty);
+}
+
+/*
+ * WORKER POOL MANAGER (-N) : GROW AND SHRINK THE POOL BETWEEN -n AND -N WORKERS
+ * Every POOL_INTERVAL_MS it looks at the requests waiting for a worker and at how busy the
+ * workers were. A backlog or busy workers add threads at once, a pool that stays mostly idle
+ * for POOL_SHRINK_INTERVALS in a row gives one back.
+ */
+void pool_manager_routine(){
+	unsigned long long busy_ns, last_busy_ns = 0;
+	long depth;
+	double busy;
+	int active, grow, i, idle_intervals = 0;
+
+	while(1){
+		usleep(POOL_INTERVAL_MS * 1000);
+		active = __atomic_load_n(&pool_target, __ATOMIC_SEQ_CST);
+		depth = __atomic_load_n(&waiting_queue_length, __ATOMIC_RELAXED) + (long)(__atomic_load_n(&ready_queue.enqueue_position, __ATOMIC_RELAXED) - __atomic_load_n(&ready_queue.dequeue_position, __ATOMIC_RELAXED));
+		busy_ns = 0;
+		for (i = 0; i < worker_max; i++)
+			busy_ns += __atomic_load_n(&worker_busy_ns[i], __ATOMIC_RELAXED);
+		busy = (double)(busy_ns - last_busy_ns) / ((double)POOL_INTERVAL_MS * 1000000 * active);
+		last_busy_ns = busy_ns;
+
+		if ((depth > 0 || busy > POOL_GROW_BUSY) && active < worker_max){
+			/* one worker for every request left waiting, at least one */
+			grow = (depth > 1) ? depth : 1;
+			if (grow > worker_max - active)
+				grow = worker_max - active;
+			printf("Pool manager(): depth %ld, busy %.2f => growing from %d to %d workers\n", depth, busy, active, active + grow);
+			for (i = 0; i < grow; i++)
+				start_worker(active + i);
+			__atomic_add_fetch(&pool_grow_events, 1, __ATOMIC_RELAXED);
+			idle_intervals = 0;
+		}
+		else if (depth == 0 && busy < POOL_SHRINK_BUSY && active > THREADNUM){
+			if (++idle_intervals >= POOL_SHRINK_INTERVALS){
+				printf("Pool manager(): busy %.2f => shrinking from %d to %d workers\n", busy, active, active - 1);
+				retire_worker();
+				__atomic_add_fetch(&pool_shrink_events, 1, __ATOMIC_RELAXED);
+				idle_intervals = 0;
+			}
+		}
+		else{
+			idle_intervals = 0;
+		}
+	}
+}
+
+/*
+ * WORKER AFFINITY (-A) : cpu PINS WORKER i TO ONE CPU, node TO ALL THE CPUS OF ONE NUMA NODE
+ * Workers come after the listeners when those are pinned too. The buffers of a worker are
+ * allocated by the worker itself after it is placed, so first touch puts them on its node.
+ */
+void place_worker(int worker_id){
+	char path[64], cpu_list[256], *range, *saveptr = NULL;
+	int nodes = 0, first, last, cpu;
+	cpu_set_t cpus;
+	FILE *fp;
+
+	if (worker_affinity == AFFINITY_CPU){
+		/* with -j the workers of process i follow those of process i - 1 */
+		if (prefork_count > 0)
+			pin_to_cpu(process_index * worker_max + worker_id);
+		else
+			pin_to_cpu((pin_listeners ? listener_count : 0) + worker_id);
+		return;
+	}
+
+	/* count the NUMA nodes, then take the CPU list of node worker_id % nodes */
+	while (1){
+		snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", nodes);
+		if (access(path, R_OK) != 0)
+			break;
+		nodes++;
+	}
+	if (nodes == 0)
+		return;
+	snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", worker_id % nodes);
+	fp = fopen(path, "r");
+	if (fp == NULL)
+		return;
+	if (fgets(cpu_list, sizeof(cpu_list), fp) == NULL)
+		cpu_list[0] = '\0';
+	fclose(fp);
+
+	/* a list such as 0-3,8-11 */
+	CPU_ZERO(&cpus);
+	for (range = strtok_r(cpu_list, ",\n", &saveptr); range != NULL; range = strtok_r(NULL, ",\n", &saveptr)){
+		if (sscanf(range, "%d-%d", &first, &last) == 1)
+			last = first;
+		for (cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++)
+			CPU_SET(cpu, &cpus);
+	}
+	if (CPU_COUNT(&cpus) == 0 || pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0)
+		printf("Could not place worker %d on NUMA node %d\n", worker_id, worker_id % nodes);
+}
+
+/*
+ * CONTENT CACHE : LOOK UP A FILE, RETURNS THE ENTRY WITH A REFERENCE TAKEN OR NULL ON A MISS
+ */
+CacheEntry *cache_lookup(char file_path[]){
+	unsigned long hash = hash_string(file_path);
+	CacheShard *shard = &cache_shards[hash % CACHE_SHARDS];
+	CacheEntry *entry;
+	struct stat file_info;
+	time_t now;
+
+	pthread_mutex_lock(&shard -> mutex);
+	entry = cache_find_entry(shard, file_path, hash);
+	if (entry != NULL && (inotify_fd < 0 || entry -> unwatched)){
+		/* no inotify : revalidate the entry against the file at most once a second */
+		now = time(NULL);
+		if (now != entry -> checked){
+			entry -> checked = now;
+			if (stat(file_path, &file_info) != 0 || file_info.st_mtime != entry -> mtime || file_info.st_size != entry -> size){
+				cache_remove_entry(shard, entry);
+				__atomic_add_fetch(&cache_invalidations, 1, __ATOMIC_RELAXED);
+				entry = NULL;
+			}
+		}
+	}
+	if (entry != NULL){
+		entry -> referenced = 1;
+		__atomic_add_fetch(&entry -> references, 1, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&cache_hits, 1, __ATOMIC_RELAXED);
+	}
+	else{
+		__atomic_add_fetch(&cache_misses, 1, __ATOMIC_RELAXED);
+	}
+	pthread_mutex_unlock(&shard -> mutex);
+	return entry;
+}
+
+/*
+ * CONTENT CACHE : READ A FILE INTO MEMORY AND INSERT IT, RETURNS THE ENTRY WITH A REFERENCE TAKEN
+ * NULL if the file cannot be read or is too large to be worth caching
+ */
+CacheEntry *cache_fill(char file_path[]){
+	unsigned long hash = hash_string(file_path), generation;
+	CacheShard *shard = &cache_shards[hash % CACHE_SHARDS];
+	CacheEntry *entry, **bucket;
+	struct stat file_info;
+	int filefd;
+	ssize_t return_value;
+	long offset = 0;
+	int watched;
+
+	/* watch the directory before reading so that a change made while reading is not missed */
+	watched = cache_watch_directory(file_path);
+	generation = __atomic_load_n(&cache_generation, __ATOMIC_ACQUIRE);
+
+	filefd = open(file_path, O_RDONLY);
+	if (filefd < 0)
+		return NULL;
+	if (fstat(filefd, &file_info) != 0 || !S_ISREG(file_info.st_mode) || file_info.st_size > cache_capacity / CACHE_SHARDS / 4){
+		close(filefd);
+		return NULL;
+	}
+
+	entry = (CacheEntry *)calloc(1, sizeof(CacheEntry));
+	entry -> content = (char *)malloc(file_info.st_size + 1);
+	while (offset < file_info.st_size){
+		return_value = pread(filefd, entry -> content + offset, file_info.st_size - offset, offset);
+		if (return_value < 0 && errno == EINTR)
+			continue;
+		if (return_value <= 0)
+			break;
+		offset += return_value;
+	}
+	close(filefd);
+	strcpy(entry -> file_path, file_path);
+	entry -> hash = hash;
+	entry -> size = offset;
+	entry -> mtime = file_info.st_mtime;
+	entry -> inode = file_info.st_ino;
+	entry -> header_length = build_header_fragment(entry -> header, file_path, entry -> size, entry -> mtime, entry -> inode);
+	entry -> checked = time(NULL);
+	entry -> unwatched = !watched;
+	entry -> references = 2;	/* one for the cache, one for the caller */
+
+	pthread_mutex_lock(&shard -> mutex);
+	if (generation != __atomic_load_n(&cache_generation, __ATOMIC_ACQUIRE) || cache_find_entry(shard, file_path, hash) != NULL){
+		/* a file changed while reading, or another worker filled it first : serve this copy uncached */
+		pthread_mutex_unlock(&shard -> mutex);
+		entry -> references = 1;
+		return entry;
+	}
+
+	/* CLOCK eviction : sweep the hand, giving referenced entries a second chance */
+	while (shard -> used_bytes + entry -> size > cache_capacity / CACHE_SHARDS && shard -> clock_hand != NULL){
+		if (shard -> clock_hand -> referenced){
+			shard -> clock_hand -> referenced = 0;
+			shard -> clock_hand = shard -> clock_hand -> clock_next;
+		}
+		else{
+			cache_remove_entry(shard, shard -> clock_hand);
+			__atomic_add_fetch(&cache_evictions, 1, __ATOMIC_RELAXED);
+		}
+	}
+
+	bucket = &shard -> buckets[(hash / CACHE_SHARDS) % CACHE_BUCKETS];
+	entry -> hash_next = *bucket;
+	*bucket = entry;
+	if (shard -> clock_hand == NULL){
+		entry -> clock_next = entry;
+		entry -> clock_previous = entry;
+		shard -> clock_hand = entry;
+	}
+	else{
+		/* insert just behind the hand so the entry gets a full sweep before it is considered */
+		entry -> clock_next = shard -> clock_hand;
+		entry -> clock_previous = shard -> clock_hand -> clock_previous;
+		entry -> clock_previous -> clock_next = entry;
+		shard -> clock_hand -> clock_previous = entry;
+	}
+	shard -> used_bytes += entry -> size;
+	pthread_mutex_unlock(&shard -> mutex);
+	return entry;
+}
+
+CacheEntry *cache_find_entry(CacheShard *shard, char file_path[], unsigned long hash){
+	CacheEntry *entry;
+
+	for (entry = shard -> buckets[(hash / CACHE_SHARDS) % CACHE_BUCKETS]; entry != NULL; entry = entry -> hash_next){
+		if (entry -> hash == hash && strcmp(entry -> file_path, file_path) == 0)
+			return entry;
+	}
+	return NULL;
+}
+
+/*
+ * UNLINK AN ENTRY FROM ITS SHARD (SHARD LOCK HELD) AND DROP THE CACHE'S REFERENCE
+ */
+void cache_remove_entry(CacheShard *shard, CacheEntry *entry){
+	CacheEntry **bucket;
+
+	for (bucket = &shard -> buckets[(entry -> hash / CACHE_SHARDS) % CACHE_BUCKETS]; *bucket != entry; bucket = &(*bucket) -> hash_next)
+		;
+	*bucket = entry -> hash_next;
+
+	if (entry -> clock_next == entry){
+		shard -> clock_hand = NULL;
+	}
+	else{
+		entry -> clock_previous -> clock_next = entry -> clock_next;
+		entry -> clock_next -> clock_previous = entry -> clock_previous;
+		if (shard -> clock_hand == entry)
+			shard -> clock_hand = entry -> clock_next;
+	}
+	shard -> used_bytes -= entry -> size;
+	cache_release(entry);
+}
+
+/*
+ * DROP A REFERENCE : THE LAST ONE FREES THE CONTENT
+ */
+void cache_release(CacheEntry *entry){
+	if (__atomic_sub_fetch(&entry -> references, 1, __ATOMIC_ACQ_REL) == 0){
+		free(entry -> content);
+		free(entry);
+	}
+}
+
+void cache_invalidate(char file_path[]){
+	unsigned long hash = hash_string(file_path);
+	CacheShard *shard = &cache_shards[hash % CACHE_SHARDS];
+	CacheEntry *entry;
+
+	pthread_mutex_lock(&shard -> mutex);
+	entry = cache_find_entry(shard, file_path, hash);
+	if (entry != NULL){
+		if (debug)
+			printf("Cache(): invalidating %s\n", file_path);
+		cache_remove_entry(shard, entry);
+		__atomic_add_fetch(&cache_invalidations, 1, __ATOMIC_RELAXED);
+	}
+	pthread_mutex_unlock(&shard -> mutex);
+}
+
+void cache_flush(){
+	int i;
+
+	for (i = 0; i < CACHE_SHARDS; i++){
+		pthread_mutex_lock(&cache_shards[i].mutex);
+		while (cache_shards[i].clock_hand != NULL){
+			cache_remove_entry(&cache_shards[i], cache_shards[i].clock_hand);
+			__atomic_add_fetch(&cache_invalidations, 1, __ATOMIC_RELAXED);
+		}
+		pthread_mutex_unlock(&cache_shards[i].mutex);
+	}
+}
+
+/*
+ * ADD AN INOTIFY WATCH ON THE DIRECTORY OF THE FILE, REMEMBERING THE PATH PREFIX USED IN THE CACHE KEYS
+ * Returns 0 when no watch covers the directory : the watch table is full or inotify refused it
+ */
+int cache_watch_directory(char file_path[]){
+	char prefix[200], *slash;
+	int watch, i;
+
+	if (inotify_fd < 0)
+		return 0;
+	strcpy(prefix, file_path);
+	slash = strrchr(prefix, '/');
+	if (slash != NULL)
+		slash[1] = '\0';
+	else
+		prefix[0] = '\0';
+
+	pthread_mutex_lock(&cache_watch_mutex);
+	for (i = 0; i < cache_watch_count; i++){
+		if (strcmp(cache_watches[i].prefix, prefix) == 0){
+			pthread_mutex_unlock(&cache_watch_mutex);
+			return 1;
+		}
+	}
+	if (cache_watch_count == MAX_CACHE_WATCHES){
+		pthread_mutex_unlock(&cache_watch_mutex);
+		return 0;
+	}
+	watch = inotify_add_watch(inotify_fd, prefix[0] ? prefix : ".", IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CREATE | IN_DELETE_SELF | IN_MOVE_SELF);
+	if (watch >= 0){
+		cache_watches[cache_watch_count].watch = watch;
+		strcpy(cache_watches[cache_watch_count].prefix, prefix);
+		cache_watch_count++;
+	}
+	pthread_mutex_unlock(&cache_watch_mutex);
+	return watch >= 0;
+}
+
+/*
+ * INOTIFY ROUTINE : INVALIDATE CACHED FILES AS SOON AS THEY CHANGE ON DISK
+ */
+void cache_watch_routine(){
+	char events[4096], file_path[400];
+	struct inotify_event *event;
+	ssize_t length;
+	char *p;
+	int i;
+
+	while(1){
+		length = read(inotify_fd, events, sizeof(events));
+		if (length <= 0){
+			if (length < 0 && errno == EINTR)
+				continue;
+			perror("Error occurred in cache_watch_routine:read function");
+			return;
+		}
+		__atomic_add_fetch(&cache_generation, 1, __ATOMIC_RELEASE);
+
+		for (p = events; p < events + length; p += sizeof(struct inotify_event) + event -> len){
+			event = (struct inotify_event *)p;
+			if (event -> mask & (IN_Q_OVERFLOW | IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF)){
+				/* events were lost or a whole directory went away */
+				cache_flush();
+				continue;
+			}
+			if (event -> len == 0)
+				continue;
+
+			pthread_mutex_lock(&cache_watch_mutex);
+			for (i = 0; i < cache_watch_count && cache_watches[i].watch != event -> wd; i++)
+				;
+			file_path[0] = '\0';
+			if (i < cache_watch_count)
+				snprintf(file_path, sizeof(file_path), "%s%s", cache_watches[i].prefix, event -> name);
+			pthread_mutex_unlock(&cache_watch_mutex);
+			if (file_path[0] != '\0')
+				cache_invalidate(file_path);
+		}
+	}
+}
+
+/*
+ * FNV-1a HASH OF A STRING
+ */
+unsigned long hash_string(char *string){
+	unsigned long hash = 14695981039346656037UL;
+
+	while (*string){
+		hash ^= (unsigned char)*string++;
+		hash *= 1099511628211UL;
+	}
+	return hash;
+}
+
+/*
+ * STAGE HISTOGRAMS : RECORD THE INTERVALS OF A SERVED REQUEST IN THE CALLING THREAD'S HISTOGRAMS
+ * Only the owning thread writes them, so no lock or read-modify-write atomic is needed
+ */
+void record_request_stages(Node *node){
+	StageHistograms *histograms = stage_histograms;
+	long long value;
+	int i, bucket;
+
+	if (histograms == NULL){
+		pthread_mutex_lock(&stage_histograms_mutex);
+		if (stage_histograms_count < MAX_STAGE_HISTOGRAMS){
+			histograms = (StageHistograms *)calloc(1, sizeof(StageHistograms));
+			stage_histograms_list[stage_histograms_count] = histograms;
+			__atomic_store_n(&stage_histograms_count, stage_histograms_count + 1, __ATOMIC_RELEASE);
+		}
+		pthread_mutex_unlock(&stage_histograms_mutex);
+		if (histograms == NULL)
+			return;
+		stage_histograms = histograms;
+	}
+
+	for (i = 0; i < INTERVAL_COUNT; i++){
+		/* the total runs from the accept, every other interval from the stage before it */
+		if (i == INTERVAL_TOTAL)
+			value = node -> stage_ns[STAGE_LAST_BYTE] - node -> stage_ns[STAGE_ACCEPTED];
+		else
+			value = node -> stage_ns[i + 1] - node -> stage_ns[i];
+		if (value < 0)
+			value = 0;
+		bucket = histogram_bucket(value);
+		__atomic_store_n(&histograms -> buckets[i][bucket], histograms -> buckets[i][bucket] + 1, __ATOMIC_RELAXED);
+		__atomic_store_n(&histograms -> sum_ns[i], histograms -> sum_ns[i] + value, __ATOMIC_RELAXED);
+	}
+}
+
+/*
+ * HDR STYLE BUCKETS : VALUES BELOW 16 GET A BUCKET EACH, THEN EVERY POWER OF 2 IS SPLIT INTO 16
+ * SUB BUCKETS, SO A BUCKET IS NEVER WIDER THAN 1/16 OF ITS VALUE
+ */
+int histogram_bucket(long long value){
+	int exponent;
+
+	if (value < HISTOGRAM_SUB_BUCKETS)
+		return value;
+	exponent = 63 - __builtin_clzll(value);
+	return (exponent - 3) * HISTOGRAM_SUB_BUCKETS + ((value >> (exponent - 4)) & (HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+/* the middle of the bucket, in nanoseconds */
+long long histogram_bucket_value(int bucket){
+	int exponent;
+
+	if (bucket < HISTOGRAM_SUB_BUCKETS)
+		return bucket;
+	exponent = bucket / HISTOGRAM_SUB_BUCKETS + 3;
+	return ((long long)(HISTOGRAM_SUB_BUCKETS + bucket % HISTOGRAM_SUB_BUCKETS) << (exponent - 4)) + ((1LL << (exponent - 4)) / 2);
+}
+
+/*
+ * SERVER STATUS : WRITE THE METRICS IN THE PROMETHEUS TEXT FORMAT, RETURNS THE LENGTH WRITTEN
+ * The per thread histograms are merged here, at scrape time, instead of on the request path
+ */
+int build_server_status(char buffer[], int size){
+	static const char *interval_names[INTERVAL_COUNT] = { "parse", "enqueue", "waiting", "ready", "first_byte", "send", "total" };
+	static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+	unsigned long *merged, count, seen;
+	unsigned long long sum_ns;
+	long waiting_length, used_bytes = 0;
+	int length = 0, i, j, bucket, histograms_count;
+	ClientQueue *client;
+
+	merged = (unsigned long *)calloc(HISTOGRAM_BUCKETS, sizeof(unsigned long));
+	histograms_count = __atomic_load_n(&stage_histograms_count, __ATOMIC_ACQUIRE);
+
+#define STATUS_PRINTF(...) \
+	do { if (length < size) length += snprintf(buffer + length, size - length, __VA_ARGS__); } while (0)
+
+	STATUS_PRINTF("# HELP myhttpd_stage_latency_seconds Time a request spends in each stage, from accept to its last byte\n");
+	STATUS_PRINTF("# TYPE myhttpd_stage_latency_seconds summary\n");
+	for (i = 0; i < INTERVAL_COUNT; i++){
+		memset(merged, 0, HISTOGRAM_BUCKETS * sizeof(unsigned long));
+		count = 0;
+		sum_ns = 0;
+		for (j = 0; j < histograms_count; j++){
+			for (bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++){
+				merged[bucket] += __atomic_load_n(&stage_histograms_list[j] -> buckets[i][bucket], __ATOMIC_RELAXED);
+			}
+			sum_ns += __atomic_load_n(&stage_histograms_list[j] -> sum_ns[i], __ATOMIC_RELAXED);
+		}
+		for (bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++)
+			count += merged[bucket];
+
+		for (j = 0; j < (int)(sizeof(quantiles) / sizeof(quantiles[0])); j++){
+			seen = 0;
+			for (bucket = 0; bucket < HISTOGRAM_BUCKETS - 1; bucket++){
+				seen += merged[bucket];
+				if (seen > quantiles[j] * count)
+					break;
+			}
+			STATUS_PRINTF("myhttpd_stage_latency_seconds{stage=\"%s\",quantile=\"%g\"} %.9f\n", interval_names[i], quantiles[j], (count == 0) ? 0.0 : histogram_bucket_value(bucket) / 1e9);
+		}
+		STATUS_PRINTF("myhttpd_stage_latency_seconds_sum{stage=\"%s\"} %.9f\n", interval_names[i], sum_ns / 1e9);
+		STATUS_PRINTF("myhttpd_stage_latency_seconds_count{stage=\"%s\"} %lu\n", interval_names[i], count);
+	}
+	free(merged);
+
+	waiting_length = __atomic_load_n(&waiting_queue_length, __ATOMIC_RELAXED);
+	STATUS_PRINTF("# HELP myhttpd_queue_depth Requests currently held by each queue\n");
+	STATUS_PRINTF("# TYPE myhttpd_queue_depth gauge\n");
+	STATUS_PRINTF("myhttpd_queue_depth{queue=\"waiting\"} %ld\n", waiting_length);
+	STATUS_PRINTF("myhttpd_queue_depth{queue=\"ready\"} %ld\n", (long)(__atomic_load_n(&ready_queue.enqueue_position, __ATOMIC_RELAXED) - __atomic_load_n(&ready_queue.dequeue_position, __ATOMIC_RELAXED)));
+	if (work_stealing){
+		for (i = 0; i < THREADNUM; i++)
+			STATUS_PRINTF("myhttpd_queue_depth{queue=\"worker\",worker=\"%d\"} %ld\n", i, __atomic_load_n(&worker_queues[i].queued_count, __ATOMIC_RELAXED));
+	}
+	if (use_DRR){
+		/* the backlog of the first clients in round robin order : the next ones to be served */
+		STATUS_PRINTF("# HELP myhttpd_fair_queue_clients Clients with requests waiting in each listener\n");
+		STATUS_PRINTF("# TYPE myhttpd_fair_queue_clients gauge\n");
+		for (i = 0; i < listener_count; i++)
+			STATUS_PRINTF("myhttpd_fair_queue_clients{listener=\"%d\"} %d\n", i, __atomic_load_n(&listeners[i].fair_queue.clients, __ATOMIC_RELAXED));
+		STATUS_PRINTF("# HELP myhttpd_client_backlog Requests and bytes waiting per client\n");
+		STATUS_PRINTF("# TYPE myhttpd_client_backlog gauge\n");
+		for (i = 0; i < listener_count; i++){
+			pthread_mutex_lock(&listeners[i].waiting_queue_mutex);
+			for (client = listeners[i].fair_queue.active_head, j = 0; client != NULL && j < DRR_STATUS_CLIENTS; client = client -> active_next, j++){
+				STATUS_PRINTF("myhttpd_client_backlog{listener=\"%d\",client=\"%s\",unit=\"requests\"} %ld\n", i, client -> client_ip, client -> backlog_requests);
+				STATUS_PRINTF("myhttpd_client_backlog{listener=\"%d\",client=\"%s\",unit=\"bytes\"} %ld\n", i, client -> client_ip, client -> backlog_bytes);
+			}
+			pthread_mutex_unlock(&listeners[i].waiting_queue_mutex);
+		}
+	}
+
+	STATUS_PRINTF("# HELP myhttpd_worker_busy_seconds_total Time each worker spent serving requests\n");
+	STATUS_PRINTF("# TYPE myhttpd_worker_busy_seconds_total counter\n");
+	for (i = 0; i < worker_max; i++)
+		STATUS_PRINTF("myhttpd_worker_busy_seconds_total{worker=\"%d\"} %.9f\n", i, __atomic_load_n(&worker_busy_ns[i], __ATOMIC_RELAXED) / 1e9);
+	STATUS_PRINTF("# HELP myhttpd_workers Number of worker threads, and the bounds of the pool\n");
+	STATUS_PRINTF("# TYPE myhttpd_workers gauge\n");
+	STATUS_PRINTF("myhttpd_workers %d\n", __atomic_load_n(&pool_target, __ATOMIC_RELAXED));
+	STATUS_PRINTF("myhttpd_workers_min %d\n", THREADNUM);
+	STATUS_PRINTF("myhttpd_workers_max %d\n", worker_max);
+	STATUS_PRINTF("# HELP myhttpd_worker_pool_resizes_total Decisions of the pool manager\n");
+	STATUS_PRINTF("# TYPE myhttpd_worker_pool_resizes_total counter\n");
+	STATUS_PRINTF("myhttpd_worker_pool_resizes_total{direction=\"grow\"} %lu\n", __atomic_load_n(&pool_grow_events, __ATOMIC_RELAXED));
+	STATUS_PRINTF("myhttpd_worker_pool_resizes_total{direction=\"shrink\"} %lu\n", __atomic_load_n(&pool_shrink_events, __ATOMIC_RELAXED));
+	STATUS_PRINTF("# HELP myhttpd_uptime_seconds Time since the server started\n");
+	STATUS_PRINTF("# TYPE myhttpd_uptime_seconds counter\n");
+	STATUS_PRINTF("myhttpd_uptime_seconds %.3f\n", (get_monotonic_ns() - server_started_ns) / 1e9);
+	if (shared_stats != NULL){
+		STATUS_PRINTF("# HELP myhttpd_process_requests_total Requests served by each worker process of -j\n");
+		STATUS_PRINTF("# TYPE myhttpd_process_requests_total counter\n");
+		for (i = 0; i < shared_stats -> process_count; i++)
+			STATUS_PRINTF("myhttpd_process_requests_total{process=\"%d\"} %lu\n", i, __atomic_load_n(&shared_stats -> children[i].requests, __ATOMIC_RELAXED));
+		STATUS_PRINTF("# HELP myhttpd_process_sent_bytes_total Body bytes sent by each worker process\n");
+		STATUS_PRINTF("# TYPE myhttpd_process_sent_bytes_total counter\n");
+		for (i = 0; i < shared_stats -> process_count; i++)
+			STATUS_PRINTF("myhttpd_process_sent_bytes_total{process=\"%d\"} %lu\n", i, __atomic_load_n(&shared_stats -> children[i].bytes, __ATOMIC_RELAXED));
+		STATUS_PRINTF("# HELP myhttpd_process_queue_depth Requests queued or in service in each worker process\n");
+		STATUS_PRINTF("# TYPE myhttpd_process_queue_depth gauge\n");
+		for (i = 0; i < shared_stats -> process_count; i++)
+			STATUS_PRINTF("myhttpd_process_queue_depth{process=\"%d\"} %ld\n", i, __atomic_load_n(&shared_stats -> children[i].queue_depth, __ATOMIC_RELAXED));
+		STATUS_PRINTF("# HELP myhttpd_process_restarts_total Worker processes restarted by the master\n");
+		STATUS_PRINTF("# TYPE myhttpd_process_restarts_total counter\n");
+		for (i = 0; i < shared_stats -> process_count; i++)
+			STATUS_PRINTF("myhttpd_process_restarts_total{process=\"%d\"} %lu\n", i, __atomic_load_n(&shared_stats -> children[i].restarts, __ATOMIC_RELAXED));
+	}
+
+	for (i = 0; i < CACHE_SHARDS; i++)
+		used_bytes += __atomic_load_n(&cache_shards[i].used_bytes, __ATOMIC_RELAXED);
+	STATUS_PRINTF("# HELP myhttpd_cache_events_total Content cache lookups and removals\n");
+	STATUS_PRINTF("# TYPE myhttpd_cache_events_total counter\n");
+	STATUS_PRINTF("myhttpd_cache_events_total{event=\"hit\"} %lu\n", __atomic_load_n(&cache_hits, __ATOMIC_RELAXED));
+	STATUS_PRINTF("myhttpd_cache_events_total{event=\"miss\"} %lu\n", __atomic_load_n(&cache_misses, __ATOMIC_RELAXED));
+	STATUS_PRINTF("myhttpd_cache_events_total{event=\"eviction\"} %lu\n", __atomic_load_n(&cache_evictions, __ATOMIC_RELAXED));
+	STATUS_PRINTF("myhttpd_cache_events_total{event=\"invalidation\"} %lu\n", __atomic_load_n(&cache_invalidations, __ATOMIC_RELAXED));
+	STATUS_PRINTF("# HELP myhttpd_cache_bytes Bytes of file content held by the cache\n");
+	STATUS_PRINTF("# TYPE myhttpd_cache_bytes gauge\n");
+	STATUS_PRINTF("myhttpd_cache_bytes %ld\n", used_bytes);
+	STATUS_PRINTF("# HELP myhttpd_log_records_dropped_total Access log records lost to a full ring\n");
+	STATUS_PRINTF("# TYPE myhttpd_log_records_dropped_total counter\n");
+	STATUS_PRINTF("myhttpd_log_records_dropped_total %lu\n", __atomic_load_n(&log_records_dropped, __ATOMIC_RELAXED));
+	STATUS_PRINTF("# HELP myhttpd_requests_shed_total Requests answered 503 by admission control\n");
+	STATUS_PRINTF("# TYPE myhttpd_requests_shed_total counter\n");
+	STATUS_PRINTF("myhttpd_requests_shed_total{reason=\"queue_full\"} %lu\n", __atomic_load_n(&requests_shed_full, __ATOMIC_RELAXED));
+	STATUS_PRINTF("myhttpd_requests_shed_total{reason=\"deadline\"} %lu\n", __atomic_load_n(&requests_shed_expired, __ATOMIC_RELAXED));
+	STATUS_PRINTF("# HELP myhttpd_requests_admitted Requests admitted and not answered yet\n");
+	STATUS_PRINTF("# TYPE myhttpd_requests_admitted gauge\n");
+	STATUS_PRINTF("myhttpd_requests_admitted %ld\n", __atomic_load_n(&admitted_requests, __ATOMIC_RELAXED));
+#undef STATUS_PRINTF
+
+	return (length < size) ? length : size - 1;
+}
+
+void display_cache_statistics(){
+	printf("Cache : hits %lu misses %lu evictions %lu invalidations %lu\n", cache_hits, cache_misses, cache_evictions, cache_invalidations);
+}
+
+/*
+ * DIRECTORY LISTING CACHE : THE 404 PAGE OF A DIRECTORY, RETURNED WITH A REFERENCE TAKEN
+ * An entry is revalidated against the directory's mtime at most once a second.
+ * Returns NULL when the listing is too large to keep in memory : the caller streams it instead.
+ */
+ListingEntry *get_directory_listing(char directory[]){
+	unsigned long hash = hash_string(directory);
+	ListingEntry *entry, **link;
+	struct dirent **namelist;
+	struct stat directory_info;
+	int n, i, stat_result;
+	long length;
+	time_t now = time(NULL);
+
+	pthread_mutex_lock(&listing_mutex);
+	for (link = &listing_buckets[hash % LISTING_BUCKETS]; (entry = *link) != NULL; link = &entry -> next){
+		if (entry -> hash == hash && strcmp(entry -> directory, directory) == 0)
+			break;
+	}
+	if (entry != NULL && now != entry -> checked){
+		entry -> checked = now;
+		if (stat(directory, &directory_info) != 0 || directory_info.st_mtim.tv_sec != entry -> mtime.tv_sec || directory_info.st_mtim.tv_nsec != entry -> mtime.tv_nsec){
+			/* the directory changed : drop the stale listing */
+			*link = entry -> next;
+			listing_count--;
+			release_directory_listing(entry);
+			entry = NULL;
+		}
+	}
+	if (entry != NULL){
+		__atomic_add_fetch(&entry -> references, 1, __ATOMIC_RELAXED);
+		pthread_mutex_unlock(&listing_mutex);
+		return entry;
+	}
+	pthread_mutex_unlock(&listing_mutex);
+
+	/* miss : take the mtime before scanning so that a change made during the scan is noticed later */
+	stat_result = stat(directory, &directory_info);
+	n = scandir(directory, &namelist, 0, alphasort);
+	length = strlen(LISTING_PREFIX) + strlen(LISTING_SUFFIX);
+	for (i = 0; i < n; i++)
+		length += strlen(namelist[i] -> d_name) + 7;
+	if (length > LISTING_CACHE_MAX_BYTES){
+		for (i = 0; i < n; i++)
+			free(namelist[i]);
+		free(namelist);
+		return NULL;
+	}
+
+	/* built with memcpy at a running offset : no rescanning of the page */
+	entry = (ListingEntry *)calloc(1, sizeof(ListingEntry));
+	entry -> content = (char *)malloc(length + 1);
+	length = 0;
+	memcpy(entry -> content, LISTING_PREFIX, strlen(LISTING_PREFIX));
+	length += strlen(LISTING_PREFIX);
+	for (i = 0; i < n; i++){
+		length += sprintf(entry -> content + length, "<p>%s</p>", namelist[i] -> d_name);
+		free(namelist[i]);
+	}
+	if (n >= 0)
+		free(namelist);
+	strcpy(entry -> content + length, LISTING_SUFFIX);
+	entry -> length = length + strlen(LISTING_SUFFIX);
+	strcpy(entry -> directory, directory);
+	entry -> hash = hash;
+	entry -> checked = now;
+	entry -> references = 1;
+	if (stat_result != 0)
+		return entry;	/* nothing to revalidate against : serve it uncached */
+	entry -> mtime = directory_info.st_mtim;
+
+	pthread_mutex_lock(&listing_mutex);
+	if (listing_count < LISTING_CACHE_ENTRIES){
+		/* another worker may have listed the directory meanwhile : the newer copy replaces it */
+		for (link = &listing_buckets[hash % LISTING_BUCKETS]; *link != NULL; link = &(*link) -> next){
+			if ((*link) -> hash == hash && strcmp((*link) -> directory, directory) == 0){
+				ListingEntry *replaced = *link;
+
+				*link = replaced -> next;
+				listing_count--;
+				release_directory_listing(replaced);
+				break;
+			}
+		}
+		entry -> references = 2;	/* one for the cache, one for the caller */
+		entry -> next = listing_buckets[hash % LISTING_BUCKETS];
+		listing_buckets[hash % LISTING_BUCKETS] = entry;
+		listing_count++;
+	}
+	pthread_mutex_unlock(&listing_mutex);
+	return entry;
+}
+
+void release_directory_listing(ListingEntry *entry){
+	if (__atomic_sub_fetch(&entry -> references, 1, __ATOMIC_ACQ_REL) == 0){
+		free(entry -> content);
+		free(entry);
+	}
+}
+
+/*
+ * STREAM A LISTING TOO LARGE TO CACHE, LISTING_CHUNK_SIZE BYTES AT A TIME
+ * With chunked set every piece is framed as an HTTP/1.1 chunk, otherwise closing the connection ends the body
+ */
+int stream_directory_listing(int sockfd, char directory[], int chunked){
+	struct dirent **namelist;
+	char *chunk = (char *)malloc(LISTING_CHUNK_SIZE + 32);
+	int n, entries, i, length, name_length, result = 0;
+
+	n = scandir(directory, &namelist, 0, alphasort);
+	entries = (n < 0) ? 0 : n;
+	length = sprintf(chunk, "%s", LISTING_PREFIX);
+	for (i = 0; i <= entries; i++){
+		if (i < entries){
+			name_length = strlen(namelist[i] -> d_name);
+			if (length + name_length + 7 <= LISTING_CHUNK_SIZE){
+				length += sprintf(chunk + length, "<p>%s</p>", namelist[i] -> d_name);
+				free(namelist[i]);
+				continue;
+			}
+		}
+		else{
+			length += sprintf(chunk + length, "%s", LISTING_SUFFIX);
+		}
+		/* the chunk is full, or this is the last one */
+		if (result == 0 && length > 0)
+			result = send_listing_chunk(sockfd, chunk, length, chunked);
+		length = 0;
+		if (i < entries)
+			i--;	/* the entry that did not fit starts the next chunk */
+	}
+	if (n >= 0)
+		free(namelist);
+	if (result == 0 && chunked)
+		result = send_all(sockfd, "0\r\n\r\n", 5);
+	free(chunk);
+	return result;
+}
+
+int send_listing_chunk(int sockfd, char chunk[], int length, int chunked){
+	char chunk_size[16];
+	struct iovec iov[3];
+
+	if (!chunked)
+		return send_all(sockfd, chunk, length);
+	iov[0].iov_base = chunk_size;
+	iov[0].iov_len = sprintf(chunk_size, "%x\r\n", length);
+	iov[1].iov_base = chunk;
+	iov[1].iov_len = length;
+	iov[2].iov_base = "\r\n";
+	iov[2].iov_len = 2;
+	return send_iovec(sockfd, iov, 3, 1);
+}
+
+/*
+ * WAIT AT MOST SEND_TIMEOUT_MS FOR ROOM IN THE SOCKET BUFFER : -1 WHEN THE CLIENT STOPPED READING OR WENT AWAY
+ */
+int wait_until_writable(int sockfd){
+	struct pollfd pfd;
+	int ready;
+
+	pfd.fd = sockfd;
+	pfd.events = POLLOUT;
+	do {
+		ready = poll(&pfd, 1, SEND_TIMEOUT_MS);
+	} while (ready < 0 && errno == EINTR);
+	if (ready == 0){
+		printf("Client on socket %d took nothing for %d ms => dropping it\n", sockfd, SEND_TIMEOUT_MS);
+		return -1;
+	}
+	if (ready < 0 || (pfd.revents & (POLLERR | POLLHUP | POLLNVAL)))
+		return -1;
+	return 0;
+}
+
+/*
+ * SEND THE WHOLE BUFFER, RETRYING ON PARTIAL WRITES
+ */
+int send_all(int sockfd, char *buffer, size_t length){
+	ssize_t sent;
+
+	while (length > 0){
+		sent = send(sockfd, buffer, length, MSG_NOSIGNAL);
+		if (sent < 0){
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK){
+				/* socket buffer is full : wait until the client drains it */
+				if (wait_until_writable(sockfd) < 0)
+					return -1;
+				continue;
+			}
+			perror("Error occurred in send_all:send function");
+			return -1;
+		}
+		buffer += sent;
+		length -= sent;
+	}
+	return 0;
+}
+
+/*
+ * SEND A WHOLE IO VECTOR WITH sendmsg, RETRYING ON PARTIAL WRITES
+ * more tells the kernel a file body follows, so the header is not pushed out in a segment of its own
+ */
+int send_iovec(int sockfd, struct iovec *iov, int iov_count, int more){
+	struct msghdr message;
+	ssize_t sent;
+
+	memset(&message, 0, sizeof(message));
+	while (iov_count > 0){
+		message.msg_iov = iov;
+		message.msg_iovlen = iov_count;
+		sent = sendmsg(sockfd, &message, MSG_NOSIGNAL | (more ? MSG_MORE : 0));
+		if (sent < 0){
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK){
+				if (wait_until_writable(sockfd) < 0)
+					return -1;
+				continue;
+			}
+			perror("Error occurred in send_iovec:sendmsg function");
+			return -1;
+		}
+		/* skip what went out, the vector belongs to the caller and may be modified */
+		while (iov_count > 0 && sent >= (ssize_t)iov[0].iov_len){
+			sent -= iov[0].iov_len;
+			iov++;
+			iov_count--;
+		}
+		if (iov_count > 0){
+			iov[0].iov_base = (char *)iov[0].iov_base + sent;
+			iov[0].iov_len -= sent;
+		}
+	}
+	return 0;
+}
+
+/*
+ * RANGE HEADER : bytes=FIRST-LAST, bytes=FIRST- AND bytes=-SUFFIX, COMMA SEPARATED
+ * Returns the number of satisfiable ranges stored in ranges, -1 if none is satisfiable (416)
+ * and 0 if the header is malformed or asks for too many ranges, in which case the whole file is sent
+ */
+int parse_byte_ranges(Slice *header, long size, ByteRange ranges[]){
+	char value[200], *spec, *saveptr = NULL, *dash, *end;
+	long first, last;
+	int count = 0, specs = 0;
+
+	if (header -> length >= (int)sizeof(value) || header -> length < 6 || strncasecmp(header -> start, "bytes=", 6) != 0)
+		return 0;
+	copy_slice(value, sizeof(value), header);
+
+	for (spec = strtok_r(value + 6, ",", &saveptr); spec != NULL; spec = strtok_r(NULL, ",", &saveptr)){
+		while (*spec == ' ' || *spec == '\t')
+			spec++;
+		dash = strchr(spec, '-');
+		if (dash == NULL || ++specs > MAX_RANGES)
+			return 0;
+		if (dash == spec){
+			/* the last SUFFIX bytes */
+			last = strtol(dash + 1, &end, 10);
+			if (end == dash + 1 || last < 0)
+				return 0;
+			if (last == 0 || size == 0)
+				continue;
+			first = (last >= size) ? 0 : size - last;
+			last = size - 1;
+		}
+		else{
+			first = strtol(spec, &end, 10);
+			if (end != dash || first < 0)
+				return 0;
+			if (dash[1] == '\0' || dash[1] == ' ' || dash[1] == '\t'){
+				last = size - 1;
+			}
+			else{
+				last = strtol(dash + 1, &end, 10);
+				if (end == dash + 1 || last < first)
+					return 0;
+			}
+			if (first >= size)
+				continue;	/* this range is not satisfiable, the others may be */
+			if (last >= size)
+				last = size - 1;
+		}
+		ranges[count].first = first;
+		ranges[count].last = last;
+		count++;
+	}
+	return (count > 0) ? count : -1;
+}
+
+/*
+ * If-Range : THE RANGE ONLY APPLIES WHEN THE VALIDATOR STILL MATCHES THE FILE, OTHERWISE THE WHOLE FILE IS SENT
+ */
+int if_range_matches(HttpRequest *request, FileMetadata *metadata){
+	Slice *if_range = get_header(request, "If-Range");
+	char last_modified[30], etag[ETAG_SIZE];
+
+	if (if_range == NULL)
+		return 1;
+	/* an entity tag must match the identity representation strongly, ranges are never taken of a compressed body */
+	if (if_range -> length > 0 && (if_range -> start[0] == '"' || if_range -> start[0] == 'W')){
+		format_etag(etag, metadata -> inode, metadata -> size, metadata -> mtime, NULL);
+		return etag_list_matches(if_range, etag, 0);
+	}
+	format_http_date(metadata -> mtime, last_modified);
+	return if_range -> length == (int)strlen(last_modified) && strncmp(if_range -> start, last_modified, if_range -> length) == 0;
+}
+
+/*
+ * HEADER OF A 206 OR 416 RESPONSE, content_length IS SET TO THE LENGTH OF THE BODY WHICH FOLLOWS
+ */
+int build_range_header(char header[], int size, Node *node, char http_status[], long *content_length){
+	char last_modified[30], part_header[RANGE_PART_HEADER_SIZE], etag[ETAG_SIZE];
+	long full_size = node -> metadata.size;
+	int i;
+
+	if (node -> range_count < 0){
+		*content_length = 0;
+		return snprintf(header, size, "HTTP/1.1 %s\nServer: myhttpd-ketan 1.0\nContent-Range: bytes */%ld\nContent-Length: 0\n", http_status, full_size);
+	}
+
+	format_http_date(node -> metadata.mtime, last_modified);
+	format_etag(etag, node -> metadata.inode, full_size, node -> metadata.mtime, NULL);
+	if (node -> range_count == 1){
+		*content_length = node -> ranges[0].last - node -> ranges[0].first + 1;
+		return snprintf(header, size, "HTTP/1.1 %s\nServer: myhttpd-ketan 1.0\nLast-Modified: %s\nETag: %s\nContent-Type: %s\nAccept-Ranges: bytes\nContent-Range: bytes %ld-%ld/%ld\nContent-Length: %ld\n",
+			http_status, last_modified, etag, node -> content_type, node -> ranges[0].first, node -> ranges[0].last, full_size, *content_length);
+	}
+
+	/* multipart/byteranges : every part carries its own header */
+	*content_length = strlen(MULTIPART_END);
+	for (i = 0; i < node -> range_count; i++)
+		*content_length += format_range_part_header(part_header, node, i) + node -> ranges[i].last - node -> ranges[i].first + 1;
+	return snprintf(header, size, "HTTP/1.1 %s\nServer: myhttpd-ketan 1.0\nLast-Modified: %s\nETag: %s\nContent-Type: multipart/byteranges; boundary=%s\nAccept-Ranges: bytes\nContent-Length: %ld\n",
+		http_status, last_modified, etag, MULTIPART_BOUNDARY, *content_length);
+}
+
+int format_range_part_header(char part_header[], Node *node, int i){
+	return sprintf(part_header, "\r\n--%s\r\nContent-Type: %s\r\nContent-Range: bytes %ld-%ld/%ld\r\n\r\n", MULTIPART_BOUNDARY, node -> content_type, node -> ranges[i].first, node -> ranges[i].last, node -> metadata.size);
+}
+
+/*
+ * SEND THE REQUESTED RANGES STRAIGHT FROM THEIR OFFSETS, IN THE CACHED COPY OR IN THE FILE
+ */
+int send_ranges(Node *node){
+	char part_header[RANGE_PART_HEADER_SIZE];
+	long length;
+	int i, result = 0, multipart = (node -> range_count > 1);
+
+	for (i = 0; i < node -> range_count && result == 0; i++){
+		length = node -> ranges[i].last - node -> ranges[i].first + 1;
+		if (multipart)
+			result = send_all(node -> acceptfd, part_header, format_range_part_header(part_header, node, i));
+		if (result != 0)
+			break;
+		if (node -> archive_entry != NULL)
+			result = send_all(node -> acceptfd, archive_base + node -> archive_entry -> offset + node -> ranges[i].first, length);
+		else if (node -> cache_entry != NULL)
+			result = send_all(node -> acceptfd, node -> cache_entry -> content + node -> ranges[i].first, length);
+		else
+			result = send_file_content(node -> acceptfd, node -> filefd, node -> file_path, node -> ranges[i].first, length);
+	}
+	if (result == 0 && multipart)
+		result = send_all(node -> acceptfd, MULTIPART_END, strlen(MULTIPART_END));
+	return result;
+}
+
+/*
+ * Accept-Encoding : BIT MASK OF THE SUPPORTED CODINGS THE CLIENT TAKES, q=0 EXCLUDES A CODING
+ */
+int get_accepted_encodings(HttpRequest *request){
+	Slice *header = get_header(request, "Accept-Encoding");
+	char value[200], *token, *saveptr = NULL, *parameters, *quality;
+	int accepted = 0, coding;
+
+	if (header == NULL)
+		return 0;
+	copy_slice(value, sizeof(value), header);
+	for (token = strtok_r(value, ",", &saveptr); token != NULL; token = strtok_r(NULL, ",", &saveptr)){
+		while (*token == ' ' || *token == '\t')
+			token++;
+		parameters = strchr(token, ';');
+		if (parameters != NULL){
+			*parameters++ = '\0';
+			quality = strstr(parameters, "q=");
+			if (quality != NULL && atof(quality + 2) <= 0)
+				continue;
+		}
+		token[strcspn(token, " \t")] = '\0';
+		if (strcasecmp(token, "gzip") == 0 || strcasecmp(token, "x-gzip") == 0)
+			coding = ENCODING_GZIP;
+		else if (strcasecmp(token, "br") == 0)
+			coding = ENCODING_BR;
+		else if (strcasecmp(token, "zstd") == 0)
+			coding = ENCODING_ZSTD;
+		else if (strcmp(token, "*") == 0)
+			coding = ENCODING_GZIP | ENCODING_BR | ENCODING_ZSTD;
+		else
+			continue;
+		accepted |= coding;
+	}
+	return accepted;
+}
+
+int is_compressible(char content_type[]){
+	return strncmp(content_type, "text/", 5) == 0;
+}
+
+/*
+ * PICK THE ENCODING OF A RESPONSE : A PRECOMPRESSED SIBLING IN THE DOCUMENT ROOT FIRST, THEN THE VARIANT CACHE
+ * When neither has it the worker compresses the file, never the listener under the waiting queue lock.
+ * The job length seen by SJF becomes the compressed size whenever it is known.
+ */
+void choose_content_encoding(Node *node, int accepted){
+	static char *suffixes[] = { ".br", ".zst", ".gz" };
+	static char *encodings[] = { "br", "zstd", "gzip" };
+	static int codings[] = { ENCODING_BR, ENCODING_ZSTD, ENCODING_GZIP };
+	char sibling_path[210];
+	FileMetadata sibling;
+	PackEntry *sibling_entry;
+	VariantEntry *variant;
+	int i, filefd;
+
+	for (i = 0; i < 3; i++){
+		if (!(accepted & codings[i]))
+			continue;
+		if (node -> archive_entry != NULL){
+			/* the siblings of a packed file are packed next to it */
+			snprintf(sibling_path, sizeof(sibling_path), "%s%s", node -> file_name, suffixes[i]);
+			sibling_entry = archive_lookup(sibling_path);
+			if (sibling_entry == NULL || sibling_entry -> mtime < node -> metadata.mtime)
+				continue;
+			set_content_encoding(node, encodings[i], sibling_entry -> size);
+			node -> archive_entry = sibling_entry;
+			return;
+		}
+		snprintf(sibling_path, sizeof(sibling_path), "%s%s", node -> file_path, suffixes[i]);
+		filefd = get_file_metadata(sibling_path, &sibling, 1);
+		if (filefd < 0)
+			continue;
+		/* an older sibling was made from an older version of the file */
+		if (sibling.mtime < node -> metadata.mtime){
+			close(filefd);
+			continue;
+		}
+		set_content_encoding(node, encodings[i], sibling.size);
+		node -> filefd = filefd;
+		return;
+	}
+
+	if (!(accepted & ENCODING_GZIP) || variant_capacity <= 0 || node -> metadata.size < MIN_COMPRESS_SIZE || node -> metadata.size > variant_capacity / 8)
+		return;
+	variant = variant_lookup(node -> file_path, &node -> metadata);
+	if (variant == NULL){
+		node -> compress_pending = 1;
+		return;
+	}
+	if (variant -> length < 0){
+		/* compressing this file did not pay off */
+		variant_release(variant);
+		return;
+	}
+	set_content_encoding(node, "gzip", variant -> length);
+	node -> variant = variant;
+}
+
+/* the identity body is not needed any more */
+void set_content_encoding(Node *node, char *encoding, long size){
+	node -> content_encoding = encoding;
+	node -> file_size = size;
+	node -> archive_entry = NULL;
+	if (node -> cache_entry != NULL){
+		cache_release(node -> cache_entry);
+		node -> cache_entry = NULL;
+	}
+	if (node -> filefd >= 0){
+		close(node -> filefd);
+		node -> filefd = -1;
+	}
+}
+
+/*
+ * VARIANT CACHE : THE GZIP VARIANT OF A FILE, RETURNED WITH A REFERENCE TAKEN
+ * A variant made from another size or mtime of the file is dropped
+ */
+VariantEntry *variant_lookup(char file_path[], FileMetadata *metadata){
+	unsigned long hash = hash_string(file_path);
+	VariantEntry *entry;
+
+	pthread_mutex_lock(&variant_mutex);
+	for (entry = variant_buckets[hash % VARIANT_BUCKETS]; entry != NULL; entry = entry -> hash_next){
+		if (entry -> hash == hash && strcmp(entry -> file_path, file_path) == 0)
+			break;
+	}
+	if (entry != NULL && (entry -> mtime != metadata -> mtime || entry -> original_size != metadata -> size)){
+		variant_remove_entry(entry);
+		entry = NULL;
+	}
+	if (entry != NULL){
+		/* move to the front of the LRU list */
+		variant_unlink_lru(entry);
+		variant_link_lru(entry);
+		__atomic_add_fetch(&entry -> references, 1, __ATOMIC_RELAXED);
+	}
+	pthread_mutex_unlock(&variant_mutex);
+	return entry;
+}
+
+/*
+ * VARIANT CACHE : GZIP THE FILE OF THE NODE AND INSERT IT, RETURNS THE ENTRY WITH A REFERENCE TAKEN OR NULL
+ * A file which does not shrink is remembered with length -1 so it is not compressed again
+ */
+VariantEntry *variant_fill(Node *node){
+	VariantEntry *entry;
+	z_stream stream;
+	char *source;
+	long size = node -> metadata.size, offset = 0;
+	ssize_t return_value;
+	int filefd = node -> filefd, opened = 0, borrowed = 1;
+	unsigned long hash = hash_string(node -> file_path);
+
+	/* the identity bytes : from the archive or the content cache when they hold them, else from the file */
+	if (node -> archive_entry != NULL){
+		source = archive_base + node -> archive_entry -> offset;
+	}
+	else if (node -> cache_entry != NULL && node -> cache_entry -> size == size){
+		source = node -> cache_entry -> content;
+	}
+	else{
+		if (filefd < 0){
+			filefd = open(node -> file_path, O_RDONLY | O_CLOEXEC);
+			opened = 1;
+		}
+		if (filefd < 0)
+			return NULL;
+		source = (char *)malloc(size);
+		borrowed = 0;
+		while (offset < size){
+			return_value = pread(filefd, source + offset, size - offset, offset);
+			if (return_value < 0 && errno == EINTR)
+				continue;
+			if (return_value <= 0)
+				break;
+			offset += return_value;
+		}
+		if (opened)
+			close(filefd);
+		if (offset != size){
+			free(source);
+			return NULL;
+		}
 	}
-	file_name[j] = '\0';
 
-	/* remove the first '/' character prepended with the file name */
-	i = 0; j = 1;
-	while(i < strlen(file_name)){
-		file_name[i] = file_name[j];
-		i++; j++;
+	entry = (VariantEntry *)calloc(1, sizeof(VariantEntry));
+	strcpy(entry -> file_path, node -> file_path);
+	entry -> hash = hash;
+	entry -> mtime = node -> metadata.mtime;
+	entry -> original_size = size;
+	entry -> references = 2;	/* one for the cache, one for the caller */
+
+	memset(&stream, 0, sizeof(stream));
+	/* 15 + 16 : the largest window with a gzip wrapper */
+	if (deflateInit2(&stream, compression_level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK){
+		entry -> content = (char *)malloc(deflateBound(&stream, size));
+		stream.next_in = (unsigned char *)source;
+		stream.avail_in = size;
+		stream.next_out = (unsigned char *)entry -> content;
+		stream.avail_out = deflateBound(&stream, size);
+		if (deflate(&stream, Z_FINISH) == Z_STREAM_END && stream.total_out < (uLong)size)
+			entry -> length = stream.total_out;
+		else
+			entry -> length = -1;
+		deflateEnd(&stream);
+	}
+	else{
+		entry -> length = -1;
+	}
+	if (!borrowed)
+		free(source);
+	if (entry -> length < 0){
+		free(entry -> content);
+		entry -> content = NULL;
+	}
+	else{
+		entry -> content = (char *)realloc(entry -> content, entry -> length);
 	}
 
-	/* test for presence of '~' in the file_name */
-	i = 0;
-	if( (ptr = strchr(file_name, '~')) != NULL ){
-		ptr++;
-		while(*ptr != '/'){
-			tilde_user[i] = *ptr;
-			ptr++; i++;
+	pthread_mutex_lock(&variant_mutex);
+	/* a variant made meanwhile by another worker is replaced */
+	{
+		VariantEntry *existing;
+
+		for (existing = variant_buckets[hash % VARIANT_BUCKETS]; existing != NULL; existing = existing -> hash_next){
+			if (existing -> hash == hash && strcmp(existing -> file_path, entry -> file_path) == 0){
+				variant_remove_entry(existing);
+				break;
+			}
 		}
-		tilde_user[i] = '\0';
-		ptr++;	
-		strcpy(file_name, ptr);
-		tilde_present = 1;
 	}
+	entry -> hash_next = variant_buckets[hash % VARIANT_BUCKETS];
+	variant_buckets[hash % VARIANT_BUCKETS] = entry;
+	variant_link_lru(entry);
+	variant_used_bytes += (entry -> length > 0) ? entry -> length : 0;
+	/* evict the least recently used variants beyond the capacity */
+	while (variant_used_bytes > variant_capacity && variant_lru_tail != NULL && variant_lru_tail != entry)
+		variant_remove_entry(variant_lru_tail);
+	pthread_mutex_unlock(&variant_mutex);
+	return entry;
 }
 
-void get_request_type(char request[], char request_type[]){
-	int i = 0;
+/* unlink an entry from the hash table and the LRU list (variant_mutex held) and drop the cache's reference */
+void variant_remove_entry(VariantEntry *entry){
+	VariantEntry **bucket;
 
-	while(request[i] != ' '){
-		request_type[i] = request[i];
-		i++;
+	for (bucket = &variant_buckets[entry -> hash % VARIANT_BUCKETS]; *bucket != entry; bucket = &(*bucket) -> hash_next)
+		;
+	*bucket = entry -> hash_next;
+	variant_unlink_lru(entry);
+	variant_used_bytes -= (entry -> length > 0) ? entry -> length : 0;
+	variant_release(entry);
+}
+
+void variant_link_lru(VariantEntry *entry){
+	entry -> lru_previous = NULL;
+	entry -> lru_next = variant_lru_head;
+	if (variant_lru_head != NULL)
+		variant_lru_head -> lru_previous = entry;
+	variant_lru_head = entry;
+	if (variant_lru_tail == NULL)
+		variant_lru_tail = entry;
+}
+
+void variant_unlink_lru(VariantEntry *entry){
+	if (entry -> lru_previous != NULL)
+		entry -> lru_previous -> lru_next = entry -> lru_next;
+	else
+		variant_lru_head = entry -> lru_next;
+	if (entry -> lru_next != NULL)
+		entry -> lru_next -> lru_previous = entry -> lru_previous;
+	else
+		variant_lru_tail = entry -> lru_previous;
+}
+
+void variant_release(VariantEntry *entry){
+	if (__atomic_sub_fetch(&entry -> references, 1, __ATOMIC_ACQ_REL) == 0){
+		free(entry -> content);
+		free(entry);
 	}
-	request_type[i] = '\0';
 }
 
-/* 
- * INSERT NODE INTO THE SPECIFIED QUEUE 
+/*
+ * STRONG ENTITY TAG OF A REPRESENTATION : INODE, SIZE AND MTIME OF THE FILE, AND THE CODING OF THE BODY
+ * A compressed body is a different representation from the identity one, so it gets a different tag
  */
-int insert_into_queue(Queue *queue, Node *new_node){
-	int signal = 0;
+int format_etag(char etag[], ino_t inode, long size, time_t mtime, char *encoding){
+	return snprintf(etag, ETAG_SIZE, "\"%lx-%lx-%lx%s%s\"", (unsigned long)inode, size, (long)mtime, (encoding != NULL) ? "-" : "", (encoding != NULL) ? encoding : "");
+}
 
-	if (queue -> front == NULL && queue -> rear == NULL){   /* If queue is empty */
-		queue -> front = new_node;
-		queue -> rear = new_node;
-		signal = 1;
+/*
+ * IS etag IN THE COMMA SEPARATED LIST OF AN If-None-Match OR If-Range HEADER
+ * weak : the weak comparison of If-None-Match, a W/ prefix is ignored. Otherwise a weak tag never matches.
+ */
+int etag_list_matches(Slice *header, char etag[], int weak){
+	char *start = header -> start, *end = header -> start + header -> length, *tag_end;
+	int etag_length = strlen(etag);
+
+	while (start < end){
+		while (start < end && (*start == ' ' || *start == '\t' || *start == ','))
+			start++;
+		if (start == end)
+			break;
+		if (*start == '*')
+			return 1;
+		if (end - start > 2 && strncmp(start, "W/", 2) == 0){
+			start += 2;
+			if (!weak){
+				start = memchr(start + 1, '"', end - start - 1);
+				if (start == NULL)
+					return 0;
+				start++;
+				continue;
+			}
+		}
+		if (*start != '"')
+			return 0;
+		tag_end = memchr(start + 1, '"', end - start - 1);
+		if (tag_end == NULL)
+			return 0;
+		tag_end++;
+		if (tag_end - start == etag_length && strncmp(start, etag, etag_length) == 0)
+			return 1;
+		start = tag_end;
 	}
-	else{
-		new_node -> next = queue -> front;
-		queue -> front -> previous = new_node;
-		queue -> front = new_node;
+	return 0;
+}
+
+/* an IMF-fixdate as sent in Last-Modified, -1 when it is anything else */
+time_t parse_http_date(Slice *header){
+	char value[40];
+	struct tm broken_down;
+	char *end;
+
+	copy_slice(value, sizeof(value), header);
+	memset(&broken_down, 0, sizeof(broken_down));
+	end = strptime(value, "%a, %d %b %Y %H:%M:%S GMT", &broken_down);
+	if (end == NULL || *end != '\0')
+		return -1;
+	return timegm(&broken_down);
+}
+
+/*
+ * CONDITIONAL GET : DOES THE CLIENT ALREADY HOLD THE REPRESENTATION WHICH WOULD BE SENT
+ * If-None-Match wins over If-Modified-Since, as RFC 9110 orders them
+ */
+int is_not_modified(HttpRequest *request, Node *node, char etag[]){
+	Slice *header;
+	time_t since;
+
+	if ((header = get_header(request, "If-None-Match")) != NULL)
+		return etag_list_matches(header, etag, 1);
+	if ((header = get_header(request, "If-Modified-Since")) != NULL){
+		since = parse_http_date(header);
+		/* a date in the future is not a valid validator */
+		return since >= 0 && since <= time(NULL) && node -> metadata.mtime <= since;
 	}
-	return signal;
+	return 0;
 }
 
-/* 
- * SCHEDULER ROUTINE BEGINS 
+/*
+ * STATIC ASSET ARCHIVE : MAP THE ARCHIVE WRITTEN BY myhttpd_pack, RETURNS 0 OR -1 IF IT CANNOT BE USED
+ * With -X the whole archive is read in at once so that the first request of every file is served from memory
  */
-void scheduler_routine(){
-	Queue *queue;
-	Node *removed_node;
-	int signal = 0;
+int archive_open(char archive_path[]){
+	struct stat file_info;
+	PackHeader *header;
+	int archive_fd;
+	char *base;
 
-	queue = &waiting_queue;
-	printf("Inside scheduler\n");
-	while(1){
-		pthread_mutex_lock(&waiting_queue_mutex);
-		printf("Scheduler(): acquired the lock\n");
-		if (queue -> front == NULL && queue -> rear == NULL){
-			printf("scheduler(): Nothing to schedule => WAIT !\n");
-			pthread_cond_wait(&waiting_queue_empty, &waiting_queue_mutex);
+	archive_fd = open(archive_path, O_RDONLY | O_CLOEXEC);
+	if (archive_fd < 0 || fstat(archive_fd, &file_info) != 0 || file_info.st_size < (long)sizeof(PackHeader)){
+		perror("Error in opening the archive");
+		return -1;
+	}
+	base = (char *)mmap(NULL, file_info.st_size, PROT_READ, MAP_SHARED | (archive_prefetch ? MAP_POPULATE : 0), archive_fd, 0);
+	close(archive_fd);
+	if (base == MAP_FAILED){
+		perror("Error in mapping the archive");
+		return -1;
+	}
+	header = (PackHeader *)base;
+	if (!archive_is_valid(base, file_info.st_size)){
+		printf("%s is not an archive written by myhttpd_pack, or it is truncated or corrupt\n", archive_path);
+		munmap(base, file_info.st_size);
+		return -1;
+	}
+	if (archive_prefetch)
+		madvise(base, file_info.st_size, MADV_WILLNEED);
+
+	archive_header = header;
+	archive_buckets = (int *)(base + sizeof(PackHeader));
+	archive_entries = (PackEntry *)(archive_buckets + header -> bucket_count);
+	archive_base = base;
+	printf("Serving %d files from the archive %s (%ld bytes)\n", header -> entry_count, archive_path, (long)file_info.st_size);
+	return 0;
+}
+
+/*
+ * STATIC ASSET ARCHIVE : CHECK EVERY INDEX AND ENTRY AGAINST THE SIZE OF THE MAPPING BEFORE ANY IS TRUSTED
+ * The buckets and the next links must stay inside the entry table and every chain must end, so that
+ * a lookup terminates. Bodies must lie between data_offset and the end of the file.
+ */
+int archive_is_valid(char *base, long size){
+	PackHeader *header = (PackHeader *)base;
+	PackEntry *entries, *entry;
+	int *buckets, i, index;
+	long visited = 0;
+
+	if (memcmp(header -> magic, PACK_MAGIC, sizeof(header -> magic)) != 0)
+		return 0;
+	if (header -> bucket_count <= 0 || header -> bucket_count > (1 << 24) || (header -> bucket_count & (header -> bucket_count - 1)) != 0)
+		return 0;
+	if (header -> entry_count < 0 || header -> entry_count > size / (long)sizeof(PackEntry))
+		return 0;
+	if (header -> data_offset < (long)sizeof(PackHeader) + header -> bucket_count * (long)sizeof(int) + header -> entry_count * (long)sizeof(PackEntry) || header -> data_offset > size)
+		return 0;
+	buckets = (int *)(base + sizeof(PackHeader));
+	entries = (PackEntry *)(buckets + header -> bucket_count);
+
+	for (i = 0; i < header -> entry_count; i++){
+		entry = &entries[i];
+		if (entry -> next < -1 || entry -> next >= header -> entry_count)
+			return 0;
+		if (entry -> header_length < 0 || entry -> header_length > HEADER_FRAGMENT_SIZE)
+			return 0;
+		if (entry -> offset < header -> data_offset || entry -> offset > size || entry -> size < 0 || entry -> size > size - entry -> offset)
+			return 0;
+		if (memchr(entry -> file_path, '\0', sizeof(entry -> file_path)) == NULL || memchr(entry -> content_type, '\0', sizeof(entry -> content_type)) == NULL)
+			return 0;
+	}
+
+	/* every entry sits on exactly one chain : walking more than entry_count links means a loop */
+	for (i = 0; i < header -> bucket_count; i++){
+		if (buckets[i] < -1 || buckets[i] >= header -> entry_count)
+			return 0;
+		for (index = buckets[i]; index >= 0; index = entries[index].next){
+			if (++visited > header -> entry_count)
+				return 0;
 		}
-		else{
-			removed_node = (Node *)malloc(sizeof(Node));
-			
-			/* Take the lock on waiting queue and remove the item from it */	
-			if(use_SJF){
-				removed_node = dequeue_using_SJF(&waiting_queue);
-			}
-			else{
-				removed_node = dequeue_using_FCFS(&waiting_queue);
-			}
-			display_queue(&waiting_queue, "Waiting Queue");
+	}
+	return 1;
+}
+
+/*
+ * STATIC ASSET ARCHIVE : ONE HASH PROBE FROM THE REQUESTED PATH TO ITS ENTRY, NULL WHEN IT IS NOT PACKED
+ */
+PackEntry *archive_lookup(char file_path[]){
+	unsigned long hash = hash_string(file_path);
+	int index = archive_buckets[hash & (archive_header -> bucket_count - 1)];
+	PackEntry *entry;
+
+	while (index >= 0){
+		entry = &archive_entries[index];
+		if (entry -> hash == hash && strcmp(entry -> file_path, file_path) == 0)
+			return entry;
+		index = entry -> next;
+	}
+	return NULL;
+}
+
+/*
+ * SEND length BYTES OF THE FILE FROM offset_in_file WITH sendfile : THE BYTES GO FROM THE PAGE CACHE TO THE SOCKET
+ * WITHOUT BEING COPIED THROUGH USER SPACE AND WITHOUT A BUFFER OF file_size BYTES
+ * filefd is the descriptor opened by the metadata lookup, or -1 to open file_path here
+ */
+int send_file_content(int sockfd, int filefd, char file_path[], long offset_in_file, long length){
+	int opened = 0;
+	off_t offset = offset_in_file, end = offset_in_file + length;
+	ssize_t sent;
 
-			/* Take the lock on ready queue and insert the item into it */
-			pthread_mutex_lock(&ready_queue_mutex);
-			printf("Scheduler(): Ready queue lock acquired\n");
-			signal = insert_into_queue(&ready_queue, removed_node);
-			display_queue(&ready_queue, "Ready Queue");
-			if(signal){
-				printf("Scheduler(): Signaling the workers\n");
-				pthread_cond_signal(&ready_queue_empty);
+	if (filefd < 0){
+		filefd = open(file_path, O_RDONLY);
+		opened = 1;
+	}
+	if (filefd < 0){
+		perror("Error in file opening");
+		return -1;
+	}
+	while (offset < end){
+		sent = sendfile(sockfd, filefd, &offset, end - offset);
+		if (sent < 0){
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK){
+				if (wait_until_writable(sockfd) == 0)
+					continue;
 			}
-			pthread_mutex_unlock(&ready_queue_mutex);
-			printf("Scheduler(): Ready queue lock released\n");
+			else
+				perror("Error occurred in send_file_content:sendfile function");
+			if (opened)
+				close(filefd);
+			return -1;
+		}
+		if (sent == 0){
+			/* the file shrank since its size was taken : Content-Length cannot be met, the connection must close */
+			if (opened)
+				close(filefd);
+			return -1;
 		}
-		pthread_mutex_unlock(&waiting_queue_mutex);
-		printf("Scheduler(): released the lock\n");
 	}
+	if (opened)
+		close(filefd);
+	return 0;
+}
+
+void append_to_log_file(char client_ip[], char arrival_time[], char current_timestamp[], char first_line_of_request[], char *http_status, char char_file_size[]){
+	char buffer[500];
+
+	snprintf(buffer, sizeof(buffer), "%s - [%s] [%s] '%s' %s %s", client_ip, arrival_time, current_timestamp, first_line_of_request, http_status, char_file_size);
+	if (debug)
+		printf("Log Content is : \n%s\n", buffer);
+
+	/* handed to the log writer thread */
+	log_record(buffer);
 }
 
 /*
- * WORKER ROUTINE
+ * ACCESS LOG : QUEUE A RECORD ON THE CALLING THREAD'S RING, NEVER BLOCKS
+ * When the ring is full the record is dropped and counted instead
  */
-void worker_routine(){
-	Queue *queue;
-	Node *removed_node;
-	//unsigned char buffer[16385];
-	unsigned char *buffer, header[500], *fof_buffer;
-	char *temp, http_status[20], current_timestamp[30], last_modified[30], char_file_size[80], ch, first_line_of_request[50];
-	size_t file_length;
-	FILE *fp;
-	long int response_size;
-	
-	queue = &ready_queue;
-	while(1){
-		pthread_mutex_lock(&ready_queue_mutex);
-		printf("Worker(): acquired the lock\n");
+void log_record(char record[]){
+	LogRing *ring = log_ring;
+	unsigned long head, tail;
+	int index;
 
-		/* If ready queue is empty : wait */
-		if(queue -> front == NULL && queue -> rear == NULL){
-			printf("Worker(): Nothing to serve => WAIT !\n");
-			pthread_cond_wait(&ready_queue_empty, &ready_queue_mutex);
+	if (ring == NULL){
+		/* first record of this thread : register its ring with the writer */
+		pthread_mutex_lock(&log_rings_mutex);
+		if (log_ring_count < MAX_LOG_RINGS){
+			ring = (LogRing *)calloc(1, sizeof(LogRing));
+			log_rings[log_ring_count] = ring;
+			__atomic_store_n(&log_ring_count, log_ring_count + 1, __ATOMIC_RELEASE);
 		}
-		else{
-			/* Dequeue the Ready queue */
-			removed_node = dequeue_using_FCFS(&ready_queue);
-			printf("Here Removed Node is : \n");
-			print_node(removed_node);
-			display_queue(&ready_queue, "Ready Queue");
+		pthread_mutex_unlock(&log_rings_mutex);
+		if (ring == NULL){
+			__atomic_add_fetch(&log_records_dropped, 1, __ATOMIC_RELAXED);
+			return;
+		}
+		log_ring = ring;
+	}
 
-			/* create header */
-			memset(header, 0, sizeof(header));
-			
-			/* 1st line */
-			strcat(header, "HTTP/1.1 ");
-			get_http_status(removed_node, http_status);
-			strcat(header, http_status);
-			strcat(header, "\n");
-			
-			/* 2nd line */
-			get_current_time(current_timestamp);
-			strcat(header, "Date: ");
-			strcat(header, current_timestamp);
-			strcat(header, "\n");
+	head = ring -> head;
+	tail = __atomic_load_n(&ring -> tail, __ATOMIC_ACQUIRE);
+	if (head - tail == LOG_RING_RECORDS){
+		__atomic_add_fetch(&ring -> dropped, 1, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&log_records_dropped, 1, __ATOMIC_RELAXED);
+		return;
+	}
+	index = head % LOG_RING_RECORDS;
+	strncpy(ring -> records[index], record, LOG_RECORD_SIZE - 2);
+	ring -> records[index][LOG_RECORD_SIZE - 2] = '\0';
+	strcat(ring -> records[index], "\n");
+	__atomic_store_n(&ring -> head, head + 1, __ATOMIC_RELEASE);
 
-			/* 3rd line */
-			strcat(header, "Server: myhttpd-ketan 1.0\n");
+	/* half full : wake the writer early rather than dropping records */
+	if (head + 1 - tail == LOG_RING_RECORDS / 2)
+		unpark(&log_writer_parking);
+}
 
-			/* 4th line */
-			get_last_modified_time_of_file(last_modified, removed_node);
-			strcat(header, "Last-Modified: ");
-			strcat(header, last_modified);
-			strcat(header, "\n");
-
-			/* 5th line */
-			strcat(header, "Content-Type: ");
-			strcat(header, removed_node -> content_type);
-			strcat(header, "\n");
-
-			if (file_not_found){
-				/* 404 File NOT FOUND */
-				/* Append the directory structure in the buffer and send */
-				buffer = (unsigned char *)malloc(2000*sizeof(char));
-				fof_buffer = (unsigned char *)malloc(1000*sizeof(char));
-				memset(fof_buffer, 0, sizeof(fof_buffer));
-				printf("Error in opening the file !\n");
-				strcat(fof_buffer, "<html><body>");
-				strcat(fof_buffer, "<h2>404 : File not found !</h2><h4>Contnet in the current directory is : </h4>");
-				add_directory_content(fof_buffer, removed_node);
-			}
-			else
-				buffer = (unsigned char *)malloc(((strlen(header)) + removed_node -> file_size)*sizeof(char));
-			memset(buffer, 0, sizeof(buffer));
-			
-			/* 5th line */ 
-			strcat(header, "Content-Length: ");
-			if(file_not_found){
-				printf("Buffer Length is : %d\n\n", strlen(fof_buffer));
-				sprintf(char_file_size, "%d", strlen(fof_buffer));
-			}
-			else
-				sprintf(char_file_size, "%d", removed_node -> file_size);
-			strcat(header, char_file_size);
-			strcat(header, "\n\n"); /* extra blank line required */
-				
-			/* Copy the file in buffer */
-			temp = (char *)malloc(removed_node -> file_size + 1);
-			strcat(buffer, header);
-			fp = fopen(removed_node -> file_path, "r");
-			if (fp != NULL){
-				fread(temp, removed_node -> file_size, 1, fp);
-				fclose(fp);
-				temp[removed_node -> file_size] = 0;
-				strcat(buffer, temp);
-			}
-			if(file_not_found){
-				strcat(buffer, fof_buffer);
-				file_not_found = 0;
-			}
-
-			printf("Buffer is : \n%s", buffer);
-
-			/* appende to log file */
-			if (create_log){
-				memset(first_line_of_request, 0, sizeof(first_line_of_request));
-				strcat(first_line_of_request, removed_node -> request_type);
-				strcat(first_line_of_request, " ");
-				strcat(first_line_of_request, removed_node -> file_name);
-				strcat(first_line_of_request, " HTTP/1.0");
-				append_to_log_file(removed_node -> client_ip, removed_node -> arrival_time, current_timestamp, first_line_of_request, http_status, char_file_size);
-			}
-			
-			/* send the buffer to client */
-			send(removed_node -> acceptfd, buffer, strlen(buffer), 0);
-		}
-		pthread_mutex_unlock(&ready_queue_mutex);
-		printf("Worker(): released the lock\n");
-	}
-}
-
-void add_directory_content(char *buffer, Node *node){
-	char filename[512];
-	struct dirent **namelist;
-	int n = scandir(node -> current_dir, &namelist, 0, alphasort);
-	int i;
+/*
+ * LOG WRITER ROUTINE : DRAIN EVERY RING INTO ONE BUFFER AND WRITE IT WITH A SINGLE write
+ * The buffer goes out when it reaches log_flush_size or every log_flush_interval milliseconds
+ */
+void log_writer_routine(){
+	char *batch;
+	int batch_length = 0, i, length, word;
+	long long last_flush = get_monotonic_ms(), now;
+	unsigned long head, tail;
+	LogRing *ring;
 
-	for ( i = 0; i < n; i++ )
-	{ 
-		char *file_name = namelist[i]->d_name;
+	batch = (char *)malloc(log_flush_size + LOG_RECORD_SIZE);
+	while(1){
+		word = __atomic_load_n(&log_writer_parking.word, __ATOMIC_SEQ_CST);
+		for (i = 0; i < __atomic_load_n(&log_ring_count, __ATOMIC_ACQUIRE); i++){
+			ring = log_rings[i];
+			head = __atomic_load_n(&ring -> head, __ATOMIC_ACQUIRE);
+			for (tail = ring -> tail; tail != head; tail++){
+				length = strlen(ring -> records[tail % LOG_RING_RECORDS]);
+				memcpy(batch + batch_length, ring -> records[tail % LOG_RING_RECORDS], length);
+				batch_length += length;
+				if (batch_length >= log_flush_size){
+					__atomic_store_n(&ring -> tail, tail + 1, __ATOMIC_RELEASE);
+					write_log_batch(batch, batch_length);
+					batch_length = 0;
+					last_flush = get_monotonic_ms();
+				}
+			}
+			__atomic_store_n(&ring -> tail, tail, __ATOMIC_RELEASE);
+		}
 
-		/*strcpy(filename, "./");
-		strcat(filename, "/");
-		strcat(filename, file_name);*/
-		strcat(buffer, "<p>");
-		strcat(buffer, file_name); 
-		strcat(buffer, "</p>");
+		now = get_monotonic_ms();
+		if (batch_length > 0 && now - last_flush >= log_flush_interval){
+			write_log_batch(batch, batch_length);
+			batch_length = 0;
+			last_flush = now;
+		}
+		if (batch_length == 0)
+			last_flush = now;
+		park_timeout(&log_writer_parking, word, log_flush_interval);
 	}
-	strcat(buffer, "</body></html>");
 }
 
-void append_to_log_file(char client_ip[], char arrival_time[], char current_timestamp[], char first_line_of_request[], char *http_status, char char_file_size[]){
-	char buffer[500];
-	FILE *fp;
+/*
+ * WRITE A BATCH OF RECORDS, ROTATING THE LOG FILE FIRST WHEN IT IS DUE
+ */
+void write_log_batch(char batch[], int length){
+	ssize_t written;
+	char rotated_name[300];
+	time_t now = time(NULL);
+	int sequence;
 
-	memset(buffer, 0, sizeof(buffer));
-	strcat(buffer, client_ip);
-	strcat(buffer, " - [");
-	strcat(buffer, arrival_time);
-	strcat(buffer, "] [");
-	strcat(buffer, current_timestamp);
-	strcat(buffer, "] '");
-	strcat(buffer, first_line_of_request);
-	strcat(buffer, "' ");
-	strcat(buffer, http_status);
-	strcat(buffer, " ");
-	strcat(buffer, char_file_size);
-	printf("Log Content is : \n%s\n", buffer);
-
-	fp = fopen(log_file_name, "a");
- 	fprintf(fp, "%s\n", buffer);	
-	fclose(fp);
+	if ((log_rotate_size > 0 && log_file_size + length > log_rotate_size) || (log_rotate_interval > 0 && now - log_opened_at >= log_rotate_interval)){
+		close(log_fd);
+		/* several rotations within one second : name.<time>.1, .2, ... so that none overwrites an earlier one */
+		snprintf(rotated_name, sizeof(rotated_name), "%s.%ld", log_file_name, (long) now);
+		for (sequence = 1; access(rotated_name, F_OK) == 0; sequence++)
+			snprintf(rotated_name, sizeof(rotated_name), "%s.%ld.%d", log_file_name, (long) now, sequence);
+		if (rename(log_file_name, rotated_name) != 0)
+			perror("Error occurred in write_log_batch:rename function");
+		open_log_file();
+	}
+
+	while (length > 0){
+		written = write(log_fd, batch, length);
+		if (written < 0){
+			if (errno == EINTR)
+				continue;
+			perror("Error occurred in write_log_batch:write function");
+			return;
+		}
+		batch += written;
+		length -= written;
+		log_file_size += written;
+	}
 }
 
-void get_last_modified_time_of_file(char last_modified[], Node *node){
+void open_log_file(){
 	struct stat file_info;
-	char *p;
-	int i = 0;
 
-	/* function ctime appends extra /n character to the returned time hence written following code to get rid of it */
-	if (!stat(node -> file_path, &file_info)) {
-		p = ctime(&file_info.st_mtime);
-		while(p[i] != '\0'){
-			if(p[i] == '\n'){ 
-				p[i] = '\0';
-			}
-			last_modified[i] = p[i];
-			i++;
-		}
+	log_fd = open(log_file_name, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+	if (log_fd < 0){
+		perror("Error in opening the log file");
+		exit(1);
+	}
+	log_file_size = (fstat(log_fd, &file_info) == 0) ? file_info.st_size : 0;
+	log_opened_at = time(NULL);
+}
+
+
+void get_last_modified_time_of_file(char last_modified[], Node *node){
+	last_modified[0] = '\0';
+	if (node -> metadata.exists) {
+		format_http_date(node -> metadata.mtime, last_modified);
 	} 
 	else {
 		printf("Cannot display the time.\n");
 	}
 }
 
+/*
+ * DATE HEADER : FORMATTED ONCE PER SECOND AND SHARED BY EVERY WORKER
+ * Whoever first sees a new second rewrites it under a sequence lock, readers copy it and
+ * retry if the sequence moved meanwhile
+ */
+void get_cached_date(char date_line[]){
+	time_t now = time(NULL);
+	unsigned long sequence;
+
+	if (now != __atomic_load_n(&cached_date_second, __ATOMIC_ACQUIRE) && pthread_mutex_trylock(&cached_date_mutex) == 0){
+		if (now != cached_date_second){
+			__atomic_add_fetch(&cached_date_sequence, 1, __ATOMIC_ACQ_REL);
+			strcpy(cached_date_line, "Date: ");
+			format_http_date(now, cached_date_line + 6);
+			strcat(cached_date_line, "\n");
+			__atomic_store_n(&cached_date_second, now, __ATOMIC_RELEASE);
+			__atomic_add_fetch(&cached_date_sequence, 1, __ATOMIC_ACQ_REL);
+		}
+		pthread_mutex_unlock(&cached_date_mutex);
+	}
+
+	do {
+		sequence = __atomic_load_n(&cached_date_sequence, __ATOMIC_ACQUIRE);
+		memcpy(date_line, cached_date_line, DATE_LINE_SIZE);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	} while ((sequence & 1) || sequence != __atomic_load_n(&cached_date_sequence, __ATOMIC_RELAXED));
+}
+
+/* RFC 1123 date as used by the Date and Last-Modified headers */
+void format_http_date(time_t timestamp, char formatted[]){
+	struct tm broken_down;
+
+	gmtime_r(&timestamp, &broken_down);
+	strftime(formatted, 30, "%a, %d %b %Y %H:%M:%S GMT", &broken_down);
+}
+
+/*
+ * PRE-SERIALISED HEADER FRAGMENT OF A FILE : EVERY LINE OF A 200 RESPONSE THAT ONLY DEPENDS ON THE FILE
+ * Built when the file is looked up and kept with its metadata and cache entries
+ */
+int build_header_fragment(char header[], char file_path[], long size, time_t mtime, ino_t inode){
+	char content_type[15], last_modified[30], etag[ETAG_SIZE], *file_name = strrchr(file_path, '/');
+
+	get_content_type(content_type, (file_name != NULL) ? file_name + 1 : file_path);
+	format_http_date(mtime, last_modified);
+	format_etag(etag, inode, size, mtime, NULL);
+	/* the identity body of a text file is one of several representations */
+	return snprintf(header, HEADER_FRAGMENT_SIZE, "HTTP/1.1 200 OK\nServer: myhttpd-ketan 1.0\nLast-Modified: %s\nETag: %s\nContent-Type: %s\nAccept-Ranges: bytes\n%sContent-Length: %ld\n", last_modified, etag, content_type, is_compressible(content_type) ? "Vary: Accept-Encoding\n" : "", size);
+}
+
 void get_current_time(char current_timestamp[]){
 	time_t current_time;
+
+	time(&current_time);
+	format_timestamp(current_time, current_timestamp);
+}
+
+void format_timestamp(time_t timestamp, char formatted[]){
 	int i =0;
-	char *p;
+	char p[30];
 
 	/* function ctime appends extra /n character to the returned time hence written following code to get rid of it */
-	time(&current_time);
-	p = ctime(&current_time);
+	ctime_r(&timestamp, p);
 	while(p[i] != '\0'){
 		if(p[i] == '\n'){ 
 			p[i] = '\0';
 		}
-		current_timestamp[i] = p[i];
+		formatted[i] = p[i];
 		i++;
 	}
+	formatted[i] = '\0';
 }
 
 char *get_http_status(Node *node, char http_status[]){
-	struct stat x;
-
-	memset(http_status, 0 , sizeof(http_status));
-	if ( (stat(node -> file_path, &x)) != 0){
+	/* directories are not served : they get the 404 page listing their content */
+	if ( !node -> metadata.exists || node -> metadata.is_directory ){
 		printf("fopen failed !\n");
 		strcpy(http_status, "404 NOT FOUND");
-		file_not_found = 1;
+		node -> file_not_found = 1;
 	}
 	else{
+		node -> file_not_found = 0;
 		strcpy(http_status, "200 OK");
 	}
 	return http_status;
@@ -738,52 +5180,69 @@ Node *dequeue_using_FCFS(Queue *queue){
 }
 
 /* 
- * DEQUE USING SJF ALGORITHM
+ * DEQUE USING SJF ALGORITHM : POP THE ROOT OF THE HEAP AND SIFT THE LAST NODE DOWN, O(log n)
  */
-Node *dequeue_using_SJF(Queue *queue){
-	Node *temp = NULL;
-	Node *iterator;
-			
-	if( (queue -> front != NULL) && (queue -> rear != NULL) && (queue -> front == queue -> rear) ){ /* If only one element exists */
-		temp = queue -> front;
-		queue -> front = NULL;
-		queue -> rear = NULL;
+Node *dequeue_using_SJF(Heap *heap){
+	Node *temp = NULL, *last;
+	int parent = 0, child;
+
+	if (heap -> size == 0){
+		printf("\n\nThere are no elements present for dequing ! Something is wrong !\n\n");
+		return NULL;
 	}
-	else{
-		iterator = queue -> front;
-		temp = iterator;
-		while (iterator != NULL){
-			if (temp -> file_size > iterator -> file_size){
-				temp = iterator;
-			}
-			iterator = iterator -> next;
-		}
-		
-		/* change queue front and back */
-		if(temp == queue -> front){
-			queue -> front = temp -> next;
-		}
-		
-		if(temp == queue -> rear){
-			queue -> rear = temp -> previous;
-		}
 
-		/* change links to maintain list integrity */
-		if(temp -> previous != NULL)
-			temp -> previous -> next = temp -> next;
-		if(temp -> next != NULL)
-			temp -> next -> previous = temp -> previous;
-		temp -> previous = NULL;
-		temp -> next = NULL;
+	temp = heap -> nodes[0];
+	last = heap -> nodes[--heap -> size];
+	while ((child = 2 * parent + 1) < heap -> size){
+		if (child + 1 < heap -> size && heap_node_before(heap -> nodes[child + 1], heap -> nodes[child]))
+			child++;
+		if (!heap_node_before(heap -> nodes[child], last))
+			break;
+		heap -> nodes[parent] = heap -> nodes[child];
+		parent = child;
 	}
+	if (heap -> size > 0)
+		heap -> nodes[parent] = last;
 	return temp;
 }
 
+/*
+ * INSERT NODE INTO THE HEAP AND SIFT IT UP, RETURNS 1 IF THE HEAP WAS EMPTY
+ */
+int insert_into_heap(Heap *heap, Node *new_node){
+	int child, parent;
+
+	if (heap -> size == heap -> capacity){
+		heap -> capacity = (heap -> capacity == 0) ? 64 : 2 * heap -> capacity;
+		heap -> nodes = (Node **)realloc(heap -> nodes, heap -> capacity * sizeof(Node *));
+	}
+
+	child = heap -> size++;
+	while (child > 0){
+		parent = (child - 1) / 2;
+		if (!heap_node_before(new_node, heap -> nodes[parent]))
+			break;
+		heap -> nodes[child] = heap -> nodes[parent];
+		child = parent;
+	}
+	heap -> nodes[child] = new_node;
+	return heap -> size == 1;
+}
+
+/*
+ * HEAP ORDER : SHORTER JOB FIRST, THE EARLIER ARRIVAL ON A TIE
+ */
+int heap_node_before(Node *first, Node *second){
+	if (first -> sjf_key != second -> sjf_key)
+		return first -> sjf_key < second -> sjf_key;
+	return first -> sequence < second -> sequence;
+}
+
 /* 
  * CREATE A NODE FOR QUEUE 
  */
 Node *create_queue_node(int acceptfd, char request_type[], char file_name[], char client_ip[], int file_size, char file_path[], char content_type[], char current_dir[]){
-	Node *new_node = (Node *)malloc(sizeof(Node));
+	Node *new_node = (Node *)pool_alloc(&node_pool, &node_pool_cache);
 
 	strcpy(new_node -> file_name, file_name);
 	strcpy(new_node -> request_type, request_type);
@@ -793,11 +5252,111 @@ Node *create_queue_node(int acceptfd, char request_type[], char file_name[], cha
 	strcpy(new_node -> file_path, file_path);
 	strcpy(new_node -> content_type, content_type);
 	strcpy(new_node -> current_dir, current_dir);
+	new_node -> cache_entry = NULL;
+	new_node -> server_status = 0;
+	new_node -> range_count = 0;
+	new_node -> content_encoding = NULL;
+	new_node -> variant = NULL;
+	new_node -> compress_pending = 0;
+	new_node -> not_modified = 0;
+	new_node -> archive_entry = NULL;
+	new_node -> listing = NULL;
+	new_node -> filefd = -1;
 	new_node -> next = NULL;
 	new_node -> previous = NULL;
 	return new_node;
 }
 
+void free_queue_node(Node *node){
+	pool_free(&node_pool, &node_pool_cache, node);
+}
+
+/*
+ * OBJECT POOL : TAKE AN OBJECT FROM THE THREAD LOCAL FREE LIST, REFILLING IT FROM THE DEPOT IN BATCHES
+ */
+void *pool_alloc(Pool *pool, PoolCache *cache){
+	PoolObject *object;
+	char *slab;
+	int i, slab_objects;
+
+	if (cache -> free_list == NULL){
+		pthread_mutex_lock(&pool -> mutex);
+		if (pool -> free_list == NULL){
+			/* depot is empty too : carve a new slab */
+			slab_objects = POOL_SLAB_BYTES / pool -> object_size;
+			if (slab_objects < 1)
+				slab_objects = 1;
+			slab = (char *)malloc(slab_objects * pool -> object_size);
+			for (i = 0; i < slab_objects; i++){
+				object = (PoolObject *)(slab + i * pool -> object_size);
+				object -> next = pool -> free_list;
+				pool -> free_list = object;
+			}
+			pool -> free_count += slab_objects;
+			pool -> slabs++;
+		}
+		for (i = 0; i < POOL_BATCH && pool -> free_list != NULL; i++){
+			object = pool -> free_list;
+			pool -> free_list = object -> next;
+			object -> next = cache -> free_list;
+			cache -> free_list = object;
+		}
+		pool -> free_count -= i;
+		cache -> count += i;
+		pthread_mutex_unlock(&pool -> mutex);
+	}
+
+	object = cache -> free_list;
+	cache -> free_list = object -> next;
+	cache -> count--;
+	return object;
+}
+
+/*
+ * OBJECT POOL : GIVE AN OBJECT BACK TO THE THREAD LOCAL FREE LIST, RETURNING A BATCH TO THE DEPOT WHEN IT GROWS
+ * Nodes are allocated by the listener and freed by the workers, so the batches flow back through the depot
+ */
+void pool_free(Pool *pool, PoolCache *cache, void *released){
+	PoolObject *object = (PoolObject *)released, *last;
+	int i;
+
+	object -> next = cache -> free_list;
+	cache -> free_list = object;
+	cache -> count++;
+	if (cache -> count < 2 * POOL_BATCH)
+		return;
+
+	last = cache -> free_list;
+	for (i = 1; i < POOL_BATCH; i++)
+		last = last -> next;
+	pthread_mutex_lock(&pool -> mutex);
+	object = cache -> free_list;
+	cache -> free_list = last -> next;
+	last -> next = pool -> free_list;
+	pool -> free_list = object;
+	pool -> free_count += POOL_BATCH;
+	pthread_mutex_unlock(&pool -> mutex);
+	cache -> count -= POOL_BATCH;
+}
+
+/*
+ * OBJECT POOL : GIVE THE WHOLE THREAD LOCAL FREE LIST BACK TO THE DEPOT, BEFORE THE THREAD EXITS
+ */
+void pool_flush(Pool *pool, PoolCache *cache){
+	PoolObject *last;
+
+	if (cache -> free_list == NULL)
+		return;
+	for (last = cache -> free_list; last -> next != NULL; last = last -> next);
+	pthread_mutex_lock(&pool -> mutex);
+	last -> next = pool -> free_list;
+	pool -> free_list = cache -> free_list;
+	pool -> free_count += cache -> count;
+	pthread_mutex_unlock(&pool -> mutex);
+	cache -> free_list = NULL;
+	cache -> count = 0;
+}
+
 /* 
  *  DISPLAY ALL THE ELEMENTS IN QUEUE
  */
@@ -814,6 +5373,16 @@ void display_queue(Queue *queue, char *queue_type){
 	}
 }
 
+void display_heap(Heap *heap, char *queue_type){
+	int i;
+
+	printf("%s\n", queue_type);
+	printf("-----------------------------------------\n");
+	for (i = 0; i < heap -> size; i++){
+		print_node(heap -> nodes[i]);
+	}
+}
+
 void print_node(Node *node){
 		printf("Type: %s\t Socket: %d\t File: %s\t IP: %s\t Size: %d\t Content-Type: %s\t ARR : %s\nFilePath : %s\nCurrent Dir : %s\n\n", node -> request_type, node -> acceptfd, node -> file_name, node -> client_ip, node -> file_size, node -> content_type, node -> arrival_time, node -> file_path, node -> current_dir);
 }
@@ -823,7 +5392,7 @@ void print_node(Node *node){
  * */
 void usage()
 {
-	fprintf(stderr, "Usage Summary: myhttpd -d -h -l filename -p portno -r rootdirectory -t threadwaittime -n threadnumber -s scheduling\n");
+	fprintf(stderr, "Usage Summary: myhttpd -d -f -h -l filename -p portno -r rootdirectory -t threadwaittime -n threadnumber -s scheduling -b backlog -k keepalivetimeout -a sjfaging -w -c cachesize -m metadatattl -F logflushms -B logbatchkb -R logrotatemb -T logrotateseconds -z variantcachesize -L listeners -P -N maxthreads -A cpu|node -x archive -X -u -j processes -q maxadmitted -D deadlinems -Q drrquantum\n");
 	fprintf(stderr, "Give -d parameter in args to on debugging mode\n");
 	fprintf(stderr, "Give -h parameter to display the summary\n");
 	fprintf(stderr, "Give -l and then filename of logging file for example: logging.txt\n");
@@ -831,7 +5400,31 @@ void usage()
 	fprintf(stderr, "Give -r and then root directory to change default value of root directory for example: -r home/workspace/Myhttpd/\n");
 	fprintf(stderr, "Give -t and then thread time to change default wait time of scheduler thread for example: -t 30\n");
 	fprintf(stderr, "Give -n and then thread numbers to change the default value of threads for example: -n 10\n");
-	fprintf(stderr, "Give -s and then scheduling name to change default scheduling for example: -s SJF\n");
+	fprintf(stderr, "Give -s and then scheduling name to change default scheduling for example: -s SJF, -s EDF to serve the earliest deadline first, or -s DRR to share the workers fairly between client IPs\n");
+	fprintf(stderr, "Give -b and then backlog to change the default listen backlog for example: -b 4096\n");
+	fprintf(stderr, "Give -k and then seconds to change the default keep-alive idle timeout for example: -k 5\n");
+	fprintf(stderr, "Give -w to dispatch requests to per worker queues with work stealing instead of the scheduler thread\n");
+	fprintf(stderr, "Give -c and then megabytes to keep hot files in an in memory cache for example: -c 64\n");
+	fprintf(stderr, "Give -m and then milliseconds to change how long file metadata is cached, 0 to disable, for example: -m 250\n");
+	fprintf(stderr, "Give -f to keep the server in the foreground with all worker threads, for example to benchmark it\n");
+	fprintf(stderr, "Request /server-status for latency histograms, queue depths, worker utilisation and cache statistics in the Prometheus text format\n");
+	fprintf(stderr, "Give -N and then the largest number of worker threads, the pool grows from -n up to it under load for example: -N 64\n");
+	fprintf(stderr, "Give -A and then cpu to pin each worker to a CPU, or node to spread the workers over the NUMA nodes\n");
+	fprintf(stderr, "Give -L and then the number of listener threads, each accepting on its own SO_REUSEPORT socket, for example: -L 4\n");
+	fprintf(stderr, "Give -P parameter to pin listener i to CPU i, or worker process i with -j\n");
+	fprintf(stderr, "Give -u parameter to run the listeners on io_uring, epoll stays the fallback\n");
+	fprintf(stderr, "Give -q and then a number of requests to answer 503 once that many are admitted and not answered yet\n");
+	fprintf(stderr, "Give -D and then milliseconds to answer 503 to requests which waited longer than that for a worker\n");
+	fprintf(stderr, "Give -Q and then bytes to set how much a client may be sent per DRR round for example: -Q 65536\n");
+	fprintf(stderr, "Give -j parameter to prefork that many worker processes behind one master which restarts them\n");
+	fprintf(stderr, "Give -x and then an archive made by myhttpd_pack to serve the packed files from memory for example: -x site.pack\n");
+	fprintf(stderr, "Give -X parameter to read the whole archive in at startup\n");
+	fprintf(stderr, "Give -z and then megabytes to change the size of the cache of gzip compressed text files for example: -z 64\n");
+	fprintf(stderr, "Give -F and then milliseconds to change how often the access log is flushed for example: -F 200\n");
+	fprintf(stderr, "Give -B and then kilobytes to change the access log batch size for example: -B 256\n");
+	fprintf(stderr, "Give -R and then megabytes to rotate the access log by size for example: -R 100\n");
+	fprintf(stderr, "Give -T and then seconds to rotate the access log by time for example: -T 86400\n");
+	fprintf(stderr, "Give -a and then bytes per second to age waiting SJF jobs so large files are not starved for example: -a 1048576\n");
 	fprintf(stderr, "Press Ctrl+c anytime to exit the server\n");
 	exit(1);
 }
@@ -0,0 +1,150 @@
+/*
+ * MYHTTPD_PACK : PACK A DOCUMENT ROOT INTO ONE ARCHIVE FOR myhttpd -x
+ * Build with : make myhttpd_pack
+ * Usage : ./myhttpd_pack -o site.pack rootdirectory
+ *
+ * Every regular file under the root becomes an entry keyed by its path relative to the root,
+ * with the header fragment myhttpd would build for it. The server includes the same source,
+ * so the layout, the hash and the headers can not drift apart.
+ */
+#define MYHTTPD_NO_MAIN
+#include "myhttpd_ketan.c"
+#include <ftw.h>
+
+typedef struct pack_file {
+	char path[PATH_MAX];
+	char relative[160];
+	struct stat info;
+} PackFile;
+
+PackFile *pack_files = NULL;
+int pack_file_count = 0, pack_file_capacity = 0, root_length;
+
+/* nftw callback : remember every regular file */
+int collect_file(const char *path, const struct stat *info, int type, struct FTW *ftw){
+	const char *relative = path + root_length;
+
+	(void)ftw;
+	if (type != FTW_F || !S_ISREG(info -> st_mode))
+		return 0;
+	while (*relative == '/')
+		relative++;
+	if (strlen(relative) >= sizeof(pack_files[0].relative) || strlen(relative) > MAX_PATH_LENGTH){
+		fprintf(stderr, "Skipping %s : the path is too long to be requested\n", path);
+		return 0;
+	}
+	if (pack_file_count == pack_file_capacity){
+		pack_file_capacity = pack_file_capacity ? pack_file_capacity * 2 : 256;
+		pack_files = (PackFile *)realloc(pack_files, pack_file_capacity * sizeof(PackFile));
+	}
+	strcpy(pack_files[pack_file_count].path, path);
+	strcpy(pack_files[pack_file_count].relative, relative);
+	pack_files[pack_file_count].info = *info;
+	pack_file_count++;
+	return 0;
+}
+
+/* copy one file into the archive at its offset */
+int copy_file(FILE *archive, PackFile *file, PackEntry *entry){
+	char buffer[65536];
+	long copied = 0;
+	size_t length;
+	FILE *fp = fopen(file -> path, "rb");
+
+	if (fp == NULL){
+		perror(file -> path);
+		return -1;
+	}
+	fseek(archive, entry -> offset, SEEK_SET);
+	while ((length = fread(buffer, 1, sizeof(buffer), fp)) > 0){
+		fwrite(buffer, 1, length, archive);
+		copied += length;
+	}
+	fclose(fp);
+	if (copied != entry -> size){
+		fprintf(stderr, "%s changed while it was packed\n", file -> path);
+		return -1;
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[]){
+	char *output = NULL, *root, *file_name;
+	PackHeader header;
+	PackEntry *entries;
+	int *buckets, i, bucket;
+	long offset;
+	FILE *archive;
+	int ch;
+
+	while ((ch = getopt(argc, argv, "o:")) != -1){
+		if (ch == 'o')
+			output = optarg;
+		else
+			break;
+	}
+	if (output == NULL || optind != argc - 1){
+		fprintf(stderr, "Usage Summary: myhttpd_pack -o archive rootdirectory\n");
+		return 1;
+	}
+	root = argv[optind];
+	root_length = strlen(root);
+	if (nftw(root, collect_file, 64, FTW_PHYS) != 0){
+		perror(root);
+		return 1;
+	}
+
+	/* index : twice as many buckets as files, rounded up to a power of 2 */
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, PACK_MAGIC, sizeof(header.magic));
+	header.bucket_count = 1;
+	while (header.bucket_count < pack_file_count * 2)
+		header.bucket_count <<= 1;
+	header.entry_count = pack_file_count;
+	header.data_offset = sizeof(PackHeader) + header.bucket_count * sizeof(int) + pack_file_count * sizeof(PackEntry);
+	header.data_offset = (header.data_offset + PACK_ALIGNMENT - 1) & ~(long)(PACK_ALIGNMENT - 1);
+
+	buckets = (int *)malloc(header.bucket_count * sizeof(int));
+	for (i = 0; i < header.bucket_count; i++)
+		buckets[i] = -1;
+	entries = (PackEntry *)calloc(pack_file_count ? pack_file_count : 1, sizeof(PackEntry));
+	offset = header.data_offset;
+	for (i = 0; i < pack_file_count; i++){
+		strcpy(entries[i].file_path, pack_files[i].relative);
+		entries[i].hash = hash_string(entries[i].file_path);
+		entries[i].offset = offset;
+		entries[i].size = pack_files[i].info.st_size;
+		entries[i].mtime = pack_files[i].info.st_mtime;
+		entries[i].inode = pack_files[i].info.st_ino;
+		file_name = strrchr(entries[i].file_path, '/');
+		get_content_type(entries[i].content_type, (file_name != NULL) ? file_name + 1 : entries[i].file_path);
+		entries[i].header_length = build_header_fragment(entries[i].header, entries[i].file_path, entries[i].size, entries[i].mtime, entries[i].inode);
+		bucket = entries[i].hash & (header.bucket_count - 1);
+		entries[i].next = buckets[bucket];
+		buckets[bucket] = i;
+		offset = (offset + entries[i].size + PACK_ALIGNMENT - 1) & ~(long)(PACK_ALIGNMENT - 1);
+	}
+
+	archive = fopen(output, "wb");
+	if (archive == NULL){
+		perror(output);
+		return 1;
+	}
+	fwrite(&header, sizeof(header), 1, archive);
+	fwrite(buckets, sizeof(int), header.bucket_count, archive);
+	fwrite(entries, sizeof(PackEntry), pack_file_count, archive);
+	for (i = 0; i < pack_file_count; i++){
+		if (copy_file(archive, &pack_files[i], &entries[i]) < 0){
+			fclose(archive);
+			unlink(output);
+			return 1;
+		}
+	}
+	/* the last body may end before its padding : the mapping must cover it */
+	fflush(archive);
+	if (ftruncate(fileno(archive), offset) != 0)
+		perror(output);
+	fclose(archive);
+	printf("Packed %d files into %s (%ld bytes)\n", pack_file_count, output, offset);
+	return 0;
+}